@@ -1,4 +1,9 @@
 #include "APU.h"
+#include "../StateIO.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
 
 // Constructor
 APU::APU() {
@@ -6,38 +11,49 @@ APU::APU() {
   NR52 = 0xF1;
   NR51 = 0xF3;
   NR50 = 0x77;
+  updateMixer();
   frameCounter = 0;
-  audioCounter = 0;
+  frameStep = 0;
+  frameStart = 0;
+  frameTime = 0;
+  runTime = 0;
+  for (int i = 0; i < 4; i++) {
+    amplitudes[i] = 0;
+  }
+  activeChannels = 0;
+  skippedUpdates = 0;
+  outputLeft = 0;
+  outputRight = 0;
   APUEnabled = false;
-
-  // Set up SDL audio spec
-  SDL_AudioSpec audioSpec;
-  audioSpec.freq = 44100;
-  audioSpec.format = AUDIO_F32SYS;
-  audioSpec.channels = 2;         // Stereo
-  audioSpec.samples = sampleSize; // Adjust as needed
-  audioSpec.callback = NULL;
-  audioSpec.userdata = this;
-
-  SDL_AudioSpec obtainedSpec;
-  SDL_OpenAudio(&audioSpec, &obtainedSpec);
-  SDL_PauseAudio(0);
 }
 
 // APU Step
-void APU::apuStep(int cycles) {
-  if (!APUEnabled)
-    return;
-
-  // Update the frame sequencer
-  static int step = 0;
+void APU::update(int cycles) {
+  frameTime += cycles;
   frameCounter += cycles;
 
   if (frameCounter < 8192) {
-    return; // Not enough cycles for a step
+    return; // Nothing can change the output before the next step
   }
 
+  // Run the channels up to the step, clock it, and close the audio frame.
+  // Powered down, every channel is off and the frames are just silence,
+  // but they keep coming so the output stays in step with the emulation.
   frameCounter -= 8192;
+  int time = frameTime - frameCounter;
+  if (APUEnabled) {
+    runChannels(time);
+    clockFrameSequencer();
+    updateOutput(time);
+  } else {
+    runTime = time;
+  }
+  endAudioFrame(time);
+}
+
+// Frame Sequencer
+void APU::clockFrameSequencer() {
+  int step = frameStep;
   if (step % 2 == 0) {
     // Clock the length timer
     if (channelOne.getLengthEnable() && channelOne.isEnabled()) {
@@ -66,7 +82,7 @@ void APU::apuStep(int cycles) {
     channelFour.updateEnvelope();
   }
 
-  step = (step + 1) % 8;
+  frameStep = (step + 1) % 8;
 }
 
 // Reset APU
@@ -74,6 +90,7 @@ void APU::resetAPU() {
   // Reset all sound registers except NR52
   NR51 = 0xF3;          // Reset NR51 to default value
   NR50 = 0x77;          // Reset NR50 to default value
+  updateMixer();
   channelOne.reset();   // Reset channel one
   channelTwo.reset();   // Reset channel two
   channelThree.reset(); // Reset channel three
@@ -125,7 +142,10 @@ void APU::writeNR52(BYTE value) {
 }
 
 // NR51 Helper Functions
-void APU::writeNR51(BYTE value) { NR51 = value; }
+void APU::writeNR51(BYTE value) {
+  NR51 = value;
+  updateMixer();
+}
 
 void APU::writeNR51Part(BYTE channel, bool right, bool enable) {
   if (right) {
@@ -141,6 +161,7 @@ void APU::writeNR51Part(BYTE channel, bool right, bool enable) {
       NR51 &= ~(1 << (channel + 3));
     }
   }
+  updateMixer();
 }
 
 void APU::getChannelPanning(BYTE channel, bool &left, bool &right) {
@@ -149,7 +170,10 @@ void APU::getChannelPanning(BYTE channel, bool &left, bool &right) {
 }
 
 // NR50 Helper Functions
-void APU::writeNR50(BYTE value) { NR50 = value; }
+void APU::writeNR50(BYTE value) {
+  NR50 = value;
+  updateMixer();
+}
 
 void APU::setVIN(bool enable, bool right) {
   if (right) {
@@ -165,6 +189,7 @@ void APU::setVIN(bool enable, bool right) {
       NR50 &= 0x7F;
     }
   }
+  updateMixer();
 }
 
 void APU::setVolumeLevel(BYTE volume, bool right) {
@@ -175,6 +200,7 @@ void APU::setVolumeLevel(BYTE volume, bool right) {
     NR50 &= 0x8F;
     NR50 |= (volume << 4);
   }
+  updateMixer();
 }
 
 void APU::getVolumeLevel(BYTE &left, BYTE &right) {
@@ -187,110 +213,287 @@ void APU::getVIN(bool &left, bool &right) {
   right = NR50 & 0x08;
 }
 
-// APU Helper Functions
-void APU::getAudioSample(int cycles) {
-  if (!APUEnabled) {
-    return;
-  }
+// Band-limited synthesis
+// Runs every audible channel from runTime to time, one waveform edge at a
+// time. Edges are taken in time order across channels so the mix (which
+// clips) sees the same channel states the hardware would. Channels that are
+// enabled but silent cannot change the output, they only have to keep their
+// place in the waveform, which takes a few divisions.
+void APU::runChannels(int time) {
+  int active = activeChannels;
+  int edges[4];
+  edges[0] = (active & 1) ? runTime + channelOne.getTimer() : INT_MAX;
+  edges[1] = (active & 2) ? runTime + channelTwo.getTimer() : INT_MAX;
+  edges[2] = (active & 4) ? runTime + channelThree.getTimer() : INT_MAX;
+  edges[3] = (active & 8) ? runTime + channelFour.getTimer() : INT_MAX;
+
+  while (true) {
+    int channel = 0;
+    for (int i = 1; i < 4; i++) {
+      if (edges[i] < edges[channel]) {
+        channel = i;
+      }
+    }
+    int edge = edges[channel];
+    if (edge > time) {
+      break;
+    }
 
-  audioCounter += cycles;
+    int amplitude;
+    switch (channel) {
+    case 0:
+      channelOne.stepWaveform();
+      edges[0] += channelOne.getTimer();
+      amplitude = channelOne.getSample();
+      break;
+    case 1:
+      channelTwo.stepWaveform();
+      edges[1] += channelTwo.getTimer();
+      amplitude = channelTwo.getSample();
+      break;
+    case 2:
+      channelThree.stepWaveform();
+      edges[2] += channelThree.getTimer();
+      amplitude = channelThree.getSample();
+      break;
+    default: {
+      // Noise runs through all the clocks that leave its output bit alone,
+      // up to the next edge of another channel so the mix stays in order
+      int period = channelFour.getLFSRPeriod();
+      int limit =
+          std::min(std::min(edges[0], edges[1]), std::min(edges[2], time));
+      int steps = channelFour.stepWaveform((limit - edge) / period + 1);
+      edge += (steps - 1) * period;
+      edges[3] = edge + channelFour.getTimer();
+      amplitude = channelFour.getSample();
+      break;
+    }
+    }
+    if (amplitude != amplitudes[channel]) {
+      amplitudes[channel] = amplitude;
+      mixOutput(edge);
+    }
+  }
 
-  if (audioCounter < 95) {
-    return; // Not enough cycles for a sample
+  // Store what is left of each timer
+  if (edges[0] != INT_MAX)
+    channelOne.setTimer(edges[0] - time);
+  if (edges[1] != INT_MAX)
+    channelTwo.setTimer(edges[1] - time);
+  if (edges[2] != INT_MAX)
+    channelThree.setTimer(edges[2] - time);
+  if (edges[3] != INT_MAX)
+    channelFour.setTimer(edges[3] - time);
+
+  int span = time - runTime;
+  if (active != 0x0F && span > 0) {
+    if (!(active & 1) && channelOne.isEnabled())
+      channelOne.skipWaveform(span);
+    if (!(active & 2) && channelTwo.isEnabled())
+      channelTwo.skipWaveform(span);
+    if (!(active & 4) && channelThree.isEnabled())
+      channelThree.skipWaveform(span);
+    if (!(active & 8) && channelFour.isEnabled())
+      channelFour.skipWaveform(span);
+    skippedUpdates += 4 - __builtin_popcount(active);
   }
+  runTime = time;
+}
 
-  audioCounter -= 95;
-  // Get the audio samples
-  float sampleOne = channelOne.getSample();
-  float sampleTwo = channelTwo.getSample();
-  float sampleThree = channelThree.getSample();
-  float sampleFour = channelFour.getSample();
-
-  // Preform the mixing for the panning
-  BYTE volumeLeft = 0;
-  BYTE volumeRight = 0;
-  getVolumeLevel(volumeLeft, volumeRight);
-  volumeLeft = (volumeLeft * 128) / 7; // Scale to 0-128 for SDL
-  volumeRight = (volumeRight * 128) / 7;
-  float bufferLeft = 0.0f;
-  float bufferRight = 0.0f;
-  float tempLeft = 0.0f;
-  float tempRight = 0.0f;
-  bool leftChannel = false;
-  bool rightChannel = false;
-
-  // Channel 1 panning
-  getChannelPanning(1, leftChannel, rightChannel);
-  if (leftChannel) {
-    bufferLeft = (sampleOne) / 15.0f; // Normalize to 0-1
-    SDL_MixAudioFormat((Uint8 *)&tempLeft, (Uint8 *)&bufferLeft, AUDIO_F32SYS,
-                       sizeof(float), volumeLeft);
+// Record the change in the mixed output at a time
+void APU::mixOutput(int time) {
+  float left, right;
+  mixer.mix(amplitudes, left, right);
+  int newLeft = (int)lroundf(left * 32768.0f);
+  int newRight = (int)lroundf(right * 32768.0f);
+  if (newLeft != outputLeft) {
+    blipLeft.addDelta(time, newLeft - outputLeft);
+    outputLeft = newLeft;
   }
-  if (rightChannel) {
-    bufferRight = sampleOne / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempRight, (Uint8 *)&bufferRight, AUDIO_F32SYS,
-                       sizeof(float), volumeRight);
+  if (newRight != outputRight) {
+    blipRight.addDelta(time, newRight - outputRight);
+    outputRight = newRight;
   }
-  // Channel 2 panning
-  getChannelPanning(2, leftChannel, rightChannel);
-  if (leftChannel) {
-    bufferLeft = sampleTwo / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempLeft, (Uint8 *)&bufferLeft, AUDIO_F32SYS,
-                       sizeof(float), volumeLeft);
+}
+
+// Re-read every channel after registers or the frame sequencer changed them.
+// Triggers, length expiry, DAC and volume changes all happen there, so this
+// is also where the set of audible channels is updated.
+void APU::updateOutput(int time) {
+  activeChannels = (channelOne.isAudible() ? 1 : 0) |
+                   (channelTwo.isAudible() ? 2 : 0) |
+                   (channelThree.isAudible() ? 4 : 0) |
+                   (channelFour.isAudible() ? 8 : 0);
+  amplitudes[0] = channelOne.getSample();
+  amplitudes[1] = channelTwo.getSample();
+  amplitudes[2] = channelThree.getSample();
+  amplitudes[3] = channelFour.getSample();
+  mixOutput(time);
+}
+
+// Close the blip frame at time and move its samples to the output buffer
+void APU::endAudioFrame(int time) {
+  blipLeft.endFrame(time);
+  blipRight.endFrame(time);
+  frameStart += time;
+  frameTime -= time;
+  runTime -= time;
+  if (rateChanged) {
+    // Only between frames, so every delta of a frame uses the same rate
+    blipLeft.setRates(4194304.0, sampleRate * rateAdjust);
+    blipRight.setRates(4194304.0, sampleRate * rateAdjust);
+    rateChanged = false;
   }
-  if (rightChannel) {
-    bufferRight = sampleTwo / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempRight, (Uint8 *)&bufferRight, AUDIO_F32SYS,
-                       sizeof(float), volumeRight);
+
+  int available = blipLeft.samplesAvailable();
+  while (available > 0) {
+    int count = (blockSize - bufferFill) / 2;
+    if (count > available) {
+      count = available;
+    }
+    if (blipLeft.isSilent() && blipRight.isSilent()) {
+      memset(buffer + bufferFill, 0, count * 2 * sizeof(float));
+      blipLeft.skipSamples(count);
+      blipRight.skipSamples(count);
+    } else {
+      blipLeft.readSamples(buffer + bufferFill, count, 2);
+      blipRight.readSamples(buffer + bufferFill + 1, count, 2);
+    }
+    bufferFill += count * 2;
+    available -= count;
+
+    // If the buffer is full, queue it for playback
+    if (bufferFill >= blockSize) {
+      bufferFill = 0;
+      if (audioSink) {
+        audioSink->queueSamples(buffer, blockSize);
+      }
+    }
   }
-  // Channel 3 panning
-  getChannelPanning(3, leftChannel, rightChannel);
-  if (leftChannel) {
-    bufferLeft = sampleThree / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempLeft, (Uint8 *)&bufferLeft, AUDIO_F32SYS,
-                       sizeof(float), volumeLeft);
+}
+
+// APU Helper Functions
+void APU::setAudioSink(AudioSink *sink) { audioSink = sink; }
+
+void APU::setLog(APULogWriter *writer) {
+  if (log) {
+    log->stop(frameStart + frameTime); // Keep the time after the last write
   }
-  if (rightChannel) {
-    bufferRight = sampleThree / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempRight, (Uint8 *)&bufferRight, AUDIO_F32SYS,
-                       sizeof(float), volumeRight);
+  log = writer;
+  if (log) {
+    log->start(frameStart + frameTime);
+    if (rateAdjust != 1.0) {
+      rateAdjust = 1.0;
+      rateChanged = true;
+    }
   }
-  // Channel 4 panning
-  getChannelPanning(4, leftChannel, rightChannel);
-  if (leftChannel) {
-    bufferLeft = sampleFour / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempLeft, (Uint8 *)&bufferLeft, AUDIO_F32SYS,
-                       sizeof(float), volumeLeft);
+}
+
+// Changing the rate restarts the output from silence
+void APU::setSampleRate(int rate) {
+  sampleRate = rate;
+  rateAdjust = 1.0;
+  rateChanged = false;
+  blipLeft.setRates(4194304.0, sampleRate);
+  blipRight.setRates(4194304.0, sampleRate);
+  blipLeft.clear();
+  blipRight.clear();
+  outputLeft = 0;
+  outputRight = 0;
+  bufferFill = 0;
+  updateOutput(frameTime);
+}
+
+void APU::setBlockSize(int samples) {
+  // Whole stereo frames that fit in the buffer
+  samples &= ~1;
+  if (samples < 2) {
+    samples = 2;
+  } else if (samples > sampleSize) {
+    samples = sampleSize;
   }
-  if (rightChannel) {
-    bufferRight = sampleFour / 15.0f;
-    SDL_MixAudioFormat((Uint8 *)&tempRight, (Uint8 *)&bufferRight, AUDIO_F32SYS,
-                       sizeof(float), volumeRight);
+  blockSize = samples;
+  if (bufferFill >= blockSize) {
+    bufferFill = 0; // Drop what no longer fits rather than overflow
   }
+}
 
-  // Add the samples to the buffer
-  buffer[bufferFill] = tempLeft;
-  buffer[bufferFill + 1] = tempRight;
-  bufferFill += 2;
-
-  // If the buffer is full, queue it for playback
-  if (bufferFill >= sampleSize) {
-    bufferFill = 0;
-    while (SDL_GetQueuedAudioSize(1) > sampleSize * sizeof(float)) {
-      SDL_Delay(1);
-    }
-    SDL_QueueAudio(1, buffer, sampleSize * sizeof(float));
+void APU::setRateAdjust(double ratio) {
+  if (log) {
+    return; // Replays have no adjustment, the recording must not either
   }
+  rateAdjust = ratio;
+  rateChanged = true;
 }
 
-void APU::updateChannelTimers(int cycles) {
-  channelOne.updateSequenceTimer(cycles);
-  channelTwo.updateSequenceTimer(cycles);
-  channelThree.updateSampleTimer(cycles);
-  channelFour.updateLFSR(cycles);
+void APU::saveState(StateWriter &state) const {
+  state.beginSection("APU ");
+  state.put(NR52);
+  state.put(NR51);
+  state.put(NR50);
+  state.put(APUEnabled);
+  state.put(frameCounter);
+  state.put(frameStep);
+  state.put(frameTime);
+  state.put(runTime);
+  state.write(amplitudes, sizeof(amplitudes));
+  state.put(activeChannels);
+  state.put(outputLeft);
+  state.put(outputRight);
+  state.put(bufferFill);
+  state.write(buffer, bufferFill * sizeof(float));
+  blipLeft.saveState(state);
+  blipRight.saveState(state);
+  state.endSection();
+
+  channelOne.saveState(state);
+  channelTwo.saveState(state);
+  channelThree.saveState(state);
+  channelFour.saveState(state);
+}
+
+void APU::loadState(StateReader &state) {
+  int oldTime = frameTime;
+  state.openSection("APU ");
+  state.get(NR52);
+  state.get(NR51);
+  state.get(NR50);
+  state.get(APUEnabled);
+  state.get(frameCounter);
+  state.get(frameStep);
+  state.get(frameTime);
+  state.get(runTime);
+  state.read(amplitudes, sizeof(amplitudes));
+  state.get(activeChannels);
+  state.get(outputLeft);
+  state.get(outputRight);
+  state.get(bufferFill);
+  if (bufferFill < 0 || bufferFill >= sampleSize) {
+    bufferFill = 0; // Damaged
+  }
+  state.read(buffer, bufferFill * sizeof(float));
+  if (bufferFill >= blockSize) {
+    bufferFill = 0; // Saved with a larger block size
+  }
+  blipLeft.loadState(state);
+  blipRight.loadState(state);
+  updateMixer();
+  // The clock only moves forward, a log keeps going from where it was
+  frameStart += oldTime - frameTime;
+
+  channelOne.loadState(state);
+  channelTwo.loadState(state);
+  channelThree.loadState(state);
+  channelFour.loadState(state);
 }
 
 void APU::writeData(WORD address, BYTE value) {
+  if (log) {
+    log->write(frameStart + frameTime, address, value);
+  }
+  // Bring the channels up to now so the write lands at the right time
+  runChannels(frameTime);
+
   switch (address) {
   // Channel One
   case 0xFF10:
@@ -372,6 +575,8 @@ void APU::writeData(WORD address, BYTE value) {
     }
     break;
   }
+
+  updateOutput(frameTime);
 }
 
 BYTE APU::getData(WORD address) const {
@@ -438,7 +643,4 @@ BYTE APU::getData(WORD address) const {
 }
 
 // Destructor
-APU::~APU() {
-  SDL_CloseAudio();
-  SDL_Quit();
-}
\ No newline at end of file
+APU::~APU() {}
\ No newline at end of file
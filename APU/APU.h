@@ -5,12 +5,18 @@
 #include "channelOne.h"
 #include "channelThree.h"
 #include "channelTwo.h"
-#include <SDL2/SDL.h>
+#include "APULogWriter.h"
+#include "BlipBuffer.h"
+#include "Mixer.h"
+#include "../Frontend.h"
 #include <cstdint>
 #include <iostream>
 
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
+
+class StateWriter;
+class StateReader;
 #define sampleSize 2048 // Size of the audio buffer
 
 class APU {
@@ -20,9 +26,38 @@ private:
   BYTE NR50;                  // Master Volume and VIN Panning
 
   int frameCounter;
-  int audioCounter;
+  int frameStep;  // Frame sequencer step (0-7)
   int bufferFill = 0;
+  int blockSize = sampleSize;     // Floats sent to the sink at a time
   float buffer[sampleSize] = {0}; // Buffer for audio samples
+  int sampleRate = 44100;         // Output rate in Hz
+  double rateAdjust = 1.0;        // Resampling correction from the frontend
+  bool rateChanged = false;       // Apply the rate at the next audio frame
+  AudioSink *audioSink = nullptr;  // Where full buffers are sent
+  APULogWriter *log = nullptr;     // Records updates and writes if set
+  Mixer mixer;                     // Panning and master volume tables
+
+  // Band-limited synthesis
+  // Channels are only run when something can change their output: at the
+  // frame sequencer steps and before register writes. Between those points
+  // each channel jumps from one waveform edge to the next and every change
+  // in the mixed output is recorded as a delta in the blip buffers.
+  BlipBuffer blipLeft, blipRight;
+  uint64_t frameStart; // Cycles run before the current blip frame
+  int frameTime;       // Cycles since the start of the current blip frame
+  int runTime;         // Time the channels have been run up to
+  int amplitudes[4];   // Current DAC input of each channel
+  int activeChannels;  // Bit per channel that can be heard right now
+  uint64_t skippedUpdates; // Channel runs skipped because they were silent
+  int outputLeft;      // Current mixed output (1 << 15 is full scale)
+  int outputRight;
+
+  void updateMixer() { mixer.setRegisters(NR50, NR51); }
+  void clockFrameSequencer();
+  void runChannels(int time);
+  void mixOutput(int time);
+  void updateOutput(int time);
+  void endAudioFrame(int time);
 
 public:
   bool APUEnabled;
@@ -33,7 +68,7 @@ public:
 
   APU(); // Constructor
 
-  void apuStep(int cycles);
+  void update(int cycles); // Advance the APU by a number of CPU cycles
   void resetAPU();
 
   // NR52 Helper Functions
@@ -55,11 +90,27 @@ public:
   void getVIN(bool &left, bool &right);
 
   // APU Helper Functions
-  void getAudioSample(int cycles);
-  void updateChannelTimers(int cycles);
+  void setAudioSink(AudioSink *sink); // Set where audio is sent
+  // Record register writes, nullptr stops. The rate adjustment is held at
+  // 1.0 while a log is attached, a replay runs at the plain rate.
+  void setLog(APULogWriter *writer);
+  uint64_t getSkippedUpdates() const { return skippedUpdates; }
+  void setSampleRate(int rate);
+  int getSampleRate() const { return sampleRate; }
+  void setBlockSize(int samples); // Floats per block, at most sampleSize
+  // Scale the output rate by a small ratio (e.g. 0.995-1.005) so the amount
+  // of queued audio can be steered without changing the pitch noticeably.
+  // Ignored while a log is attached.
+  void setRateAdjust(double ratio);
   void writeData(WORD address, BYTE value);
   BYTE getData(WORD address) const;
 
+  // Save states, including the samples not yet sent to the sink so the
+  // audio after a load matches the audio after the save. The output format
+  // and the sink are settings and stay as they are.
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+
   // Destructor
   ~APU();
 };
@@ -0,0 +1,70 @@
+#include "APULogPlayer.h"
+#include <cstdio>
+#include <cstring>
+
+static const char logMagic[4] = {'G', 'B', 'A', 'L'};
+static const BYTE logVersion = 1;
+static const int headerSize = 8;
+
+bool APULogPlayer::isLog(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  BYTE header[headerSize];
+  size_t read = fread(header, 1, headerSize, file);
+  fclose(file);
+  return read == headerSize && memcmp(header, logMagic, 4) == 0 &&
+         header[4] == logVersion;
+}
+
+bool APULogPlayer::load(const std::string &path) {
+  if (!isLog(path)) {
+    return false;
+  }
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data.resize(size);
+  size_t read = fread(data.data(), 1, size, file);
+  fclose(file);
+  return read == (size_t)size;
+}
+
+// Waits are split so a single update never passes more than one frame
+// sequencer step, the same as the small steps of a CPU instruction
+static void wait(APU &apu, int cycles) {
+  while (cycles > 4096) {
+    apu.update(4096);
+    cycles -= 4096;
+  }
+  apu.update(cycles);
+}
+
+uint64_t APULogPlayer::play(APU &apu) const {
+  uint64_t cycles = 0;
+  size_t position = headerSize;
+  size_t size = data.size();
+  while (position < size) {
+    BYTE command = data[position++];
+    if (command == 0x61 && position + 2 <= size) {
+      int length = data[position] | (data[position + 1] << 8);
+      position += 2;
+      wait(apu, length);
+      cycles += length;
+    } else if (command >= 0x70 && command <= 0x7F) {
+      wait(apu, command - 0x6F);
+      cycles += command - 0x6F;
+    } else if (command == 0xB3 && position + 2 <= size) {
+      apu.writeData(0xFF10 + data[position], data[position + 1]);
+      position += 2;
+    } else {
+      break; // 0x66, the end of the log, or a damaged file
+    }
+  }
+  return cycles;
+}
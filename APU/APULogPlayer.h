@@ -0,0 +1,25 @@
+#ifndef APULOGPLAYER_H
+#define APULOGPLAYER_H
+
+#include "APU.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Drives an APU from a register write log (see APULogWriter for the
+// layout). No CPU, memory or GPU is involved: the waits become APU updates
+// and the writes go straight to APU::writeData, so a fresh APU produces the
+// same samples it did when the log was recorded, at the same output rate.
+class APULogPlayer {
+private:
+  std::vector<BYTE> data; // The whole log, commands start at offset 8
+
+public:
+  bool load(const std::string &path); // false if missing or not a log
+  static bool isLog(const std::string &path); // Checks the header only
+
+  // Run the whole log through the APU, returns the cycles played
+  uint64_t play(APU &apu) const;
+};
+
+#endif // APULOGPLAYER_H
@@ -0,0 +1,83 @@
+#include "APULogWriter.h"
+
+static const char logMagic[4] = {'G', 'B', 'A', 'L'};
+static const BYTE logVersion = 1;
+
+APULogWriter::APULogWriter()
+    : file(nullptr), lastTime(0), waitCycles(0), totalCycles(0), writes(0) {}
+
+APULogWriter::~APULogWriter() { close(); }
+
+bool APULogWriter::open(const std::string &path) {
+  close();
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  BYTE header[8] = {(BYTE)logMagic[0], (BYTE)logMagic[1], (BYTE)logMagic[2],
+                    (BYTE)logMagic[3], logVersion,        0,
+                    0,                 0};
+  fwrite(header, 1, sizeof(header), file);
+  pending.clear();
+  pending.reserve(1 << 16);
+  lastTime = 0;
+  waitCycles = 0;
+  totalCycles = 0;
+  writes = 0;
+  return true;
+}
+
+void APULogWriter::close() {
+  if (!file) {
+    return;
+  }
+  flushWait();
+  pending.push_back(0x66);
+  flush();
+  fclose(file);
+  file = nullptr;
+}
+
+// Turn the collected cycles into wait commands
+void APULogWriter::flushWait() {
+  totalCycles += waitCycles;
+  while (waitCycles > 16) {
+    uint64_t wait = waitCycles < 0xFFFF ? waitCycles : 0xFFFF;
+    pending.push_back(0x61);
+    pending.push_back((BYTE)wait);
+    pending.push_back((BYTE)(wait >> 8));
+    waitCycles -= wait;
+  }
+  if (waitCycles > 0) {
+    pending.push_back(0x70 + (BYTE)(waitCycles - 1));
+  }
+  waitCycles = 0;
+}
+
+void APULogWriter::flush() {
+  fwrite(pending.data(), 1, pending.size(), file);
+  pending.clear();
+}
+
+void APULogWriter::start(uint64_t time) { lastTime = time; }
+
+void APULogWriter::stop(uint64_t time) {
+  waitCycles += time - lastTime;
+  lastTime = time;
+}
+
+void APULogWriter::write(uint64_t time, WORD address, BYTE value) {
+  if (!file || address < 0xFF10 || address > 0xFF3F) {
+    return;
+  }
+  waitCycles += time - lastTime;
+  lastTime = time;
+  flushWait();
+  pending.push_back(0xB3);
+  pending.push_back((BYTE)(address - 0xFF10));
+  pending.push_back(value);
+  writes++;
+  if (pending.size() >= (1 << 16)) {
+    flush();
+  }
+}
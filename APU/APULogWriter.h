@@ -0,0 +1,53 @@
+#ifndef APULOGWRITER_H
+#define APULOGWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+
+// Records every APU register write with its timing, so the audio of a run
+// can be reproduced later from the log alone (see APULogPlayer).
+// The APU passes on each write with its own cycle count, the time between
+// writes is stored as a wait.
+//
+// File layout (VGM-like, all values little endian):
+//   "GBAL", version (1 byte), 3 reserved bytes
+//   then a stream of commands:
+//     0x61 ll hh   wait 0-65535 cycles
+//     0x70-0x7F    wait 1-16 cycles
+//     0xB3 rr dd   write dd to register 0xFF10 + rr (0x00-0x2F)
+//     0x66         end of the log
+class APULogWriter {
+private:
+  FILE *file;
+  std::vector<BYTE> pending; // Commands not yet written to the file
+  uint64_t lastTime;         // APU time of the last command
+  uint64_t waitCycles;       // Cycles not yet written as a wait
+  uint64_t totalCycles;
+  uint64_t writes;
+
+  void flushWait();
+  void flush();
+
+public:
+  APULogWriter();
+  ~APULogWriter();
+
+  bool open(const std::string &path);
+  void close(); // Ends the log, detach it from the APU first
+  bool isOpen() const { return file != nullptr; }
+
+  // Called by the APU with its cycle count, see APU::setLog
+  void start(uint64_t time);
+  void write(uint64_t time, WORD address, BYTE value);
+  void stop(uint64_t time);
+
+  uint64_t getCycles() const { return totalCycles + waitCycles; }
+  uint64_t getWrites() const { return writes; }
+};
+
+#endif // APULOGWRITER_H
@@ -0,0 +1,106 @@
+#include "BlipBuffer.h"
+#include "../StateIO.h"
+#include <cmath>
+#include <cstring>
+
+BlipBuffer::BlipBuffer() {
+  buildKernel();
+  setRates(4194304.0, 44100.0); // Until the APU sets its own
+  clear();
+}
+
+// Blackman windowed sinc, one set of taps per sub-sample phase. Each phase
+// is rounded so its taps sum to exactly 1 << deltaBits, which keeps the
+// integrator free of drift.
+void BlipBuffer::buildKernel() {
+  const double pi = 3.14159265358979323846;
+  const double cutoff = 0.45; // Fraction of the output rate
+  for (int phase = 0; phase < phaseCount; phase++) {
+    double taps[kernelWidth];
+    double sum = 0;
+    for (int i = 0; i < kernelWidth; i++) {
+      double x = i - (kernelWidth / 2 - 1) - (double)phase / phaseCount;
+      double sinc = x == 0 ? 1.0 : sin(2 * pi * cutoff * x) /
+                                       (2 * pi * cutoff * x);
+      double w = (x + kernelWidth / 2) / kernelWidth; // 0-1 across the kernel
+      double window =
+          0.42 - 0.5 * cos(2 * pi * w) + 0.08 * cos(4 * pi * w);
+      taps[i] = sinc * window;
+      sum += taps[i];
+    }
+    int total = 0;
+    int largest = 0;
+    for (int i = 0; i < kernelWidth; i++) {
+      kernel[phase][i] = (int)lround(taps[i] / sum * (1 << deltaBits));
+      total += kernel[phase][i];
+      if (kernel[phase][i] > kernel[phase][largest]) {
+        largest = i;
+      }
+    }
+    kernel[phase][largest] += (1 << deltaBits) - total;
+  }
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate) {
+  factor = (uint64_t)(sampleRate / clockRate * 4294967296.0 + 0.5);
+}
+
+void BlipBuffer::clear() {
+  offset = 0;
+  integrator = 0;
+  deltaEnd = 0;
+  memset(buffer, 0, sizeof(buffer));
+}
+
+void BlipBuffer::endFrame(int time) { offset += time * factor; }
+
+int BlipBuffer::readSamples(float *out, int count, int stride) {
+  int available = samplesAvailable();
+  if (count > available) {
+    count = available;
+  }
+  const float scale = 1.0f / (1 << (15 + deltaBits));
+  int sum = integrator;
+  for (int i = 0; i < count; i++) {
+    sum += buffer[i];
+    out[i * stride] = sum * scale;
+  }
+  integrator = sum;
+
+  // Move the unread samples and the kernel tails to the front
+  int remaining = available - count + kernelWidth;
+  memmove(buffer, buffer + count, remaining * sizeof(int));
+  memset(buffer + remaining, 0, count * sizeof(int));
+  offset -= (uint64_t)count << 32;
+  deltaEnd = deltaEnd > count ? deltaEnd - count : 0;
+  return count;
+}
+
+// The buffer holds nothing but zeros, only the position moves
+void BlipBuffer::skipSamples(int count) {
+  int available = samplesAvailable();
+  if (count > available) {
+    count = available;
+  }
+  offset -= (uint64_t)count << 32;
+}
+
+void BlipBuffer::saveState(StateWriter &state) const {
+  state.put(offset);
+  state.put(integrator);
+  state.put(deltaEnd);
+  state.write(buffer, deltaEnd * sizeof(int));
+}
+
+void BlipBuffer::loadState(StateReader &state) {
+  clear();
+  state.get(offset);
+  state.get(integrator);
+  state.get(deltaEnd);
+  if (deltaEnd < 0 || deltaEnd > maxSamples + kernelWidth ||
+      (offset >> 32) > (uint64_t)maxSamples) {
+    clear(); // Damaged, start from silence
+    return;
+  }
+  state.read(buffer, deltaEnd * sizeof(int));
+}
@@ -0,0 +1,71 @@
+#ifndef BLIP_BUFFER_H
+#define BLIP_BUFFER_H
+
+#include <cstdint>
+
+class StateWriter;
+class StateReader;
+
+// Band-limited step buffer.
+// Amplitude changes are added as deltas at their exact clock time, each one
+// spread over a few output samples with a band-limited step kernel. Reading
+// integrates the deltas back into a waveform at the output rate, so the cost
+// follows the number of edges rather than the number of emulated cycles and
+// no aliasing is introduced by point sampling.
+class BlipBuffer {
+public:
+  static const int kernelWidth = 16;  // Output samples touched by one delta
+  static const int phaseBits = 5;     // Sub-sample resolution of a delta
+  static const int phaseCount = 1 << phaseBits;
+  static const int deltaBits = 12;    // Fixed point scale of the kernels
+  static const int maxSamples = 1024; // Samples that fit in one frame
+
+private:
+  uint64_t factor;  // Output samples per clock (32.32 fixed point)
+  uint64_t offset;  // Start of the current frame (32.32 fixed point)
+  int integrator;   // Running sum of all deltas read so far
+  int deltaEnd;     // Samples past this hold no deltas
+  int buffer[maxSamples + kernelWidth];
+  int kernel[phaseCount][kernelWidth];
+
+  void buildKernel();
+
+public:
+  BlipBuffer();
+
+  void setRates(double clockRate, double sampleRate);
+  void clear();
+
+  // Add an amplitude change at a clock time relative to the frame start
+  void addDelta(int time, int delta) {
+    uint64_t position = offset + time * factor;
+    int *out = buffer + (position >> 32);
+    if ((int)(position >> 32) + kernelWidth > deltaEnd) {
+      deltaEnd = (int)(position >> 32) + kernelWidth;
+    }
+    const int *taps = kernel[(position >> (32 - phaseBits)) & (phaseCount - 1)];
+    for (int i = 0; i < kernelWidth; i++) {
+      out[i] += delta * taps[i];
+    }
+  }
+
+  // Finish a frame of the given length, making its samples available
+  void endFrame(int time);
+  int samplesAvailable() const { return (int)(offset >> 32); }
+
+  // Read up to count samples, scaled so that a delta of 1 << 15 is 1.0,
+  // writing every stride floats. Returns the number of samples read.
+  int readSamples(float *out, int count, int stride);
+
+  // True when every sample waiting to be read is 0, so reading can be
+  // replaced by skipSamples and zeros
+  bool isSilent() const { return integrator == 0 && deltaEnd == 0; }
+  void skipSamples(int count); // Only while silent
+
+  // Save states, only the part of the buffer holding deltas is stored. The
+  // rates are settings and are left as they are.
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+};
+
+#endif // BLIP_BUFFER_H
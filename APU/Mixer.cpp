@@ -0,0 +1,20 @@
+#include "Mixer.h"
+
+Mixer::Mixer() { setRegisters(0x77, 0xF3); }
+
+void Mixer::setRegisters(BYTE NR50, BYTE NR51) {
+  for (int channel = 0; channel < 4; channel++) {
+    leftMasks[channel] = (NR51 & (1 << (channel + 4))) ? -1 : 0;
+    rightMasks[channel] = (NR51 & (1 << channel)) ? -1 : 0;
+  }
+  // Master volume 0-7 scaled to 0-128, each channel is normalized to 0-1
+  // and the mix is clipped at 1
+  int volumeLeft = (((NR50 >> 4) & 0x07) * 128) / 7;
+  int volumeRight = ((NR50 & 0x07) * 128) / 7;
+  for (int sum = 0; sum <= 60; sum++) {
+    float left = (sum / 15.0f) * (volumeLeft / 128.0f);
+    float right = (sum / 15.0f) * (volumeRight / 128.0f);
+    leftLevels[sum] = left > 1.0f ? 1.0f : left;
+    rightLevels[sum] = right > 1.0f ? 1.0f : right;
+  }
+}
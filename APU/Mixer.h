@@ -0,0 +1,36 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <cstdint>
+
+typedef uint8_t BYTE;
+
+// Mixes the four channel DAC inputs (0-15) into a stereo frame.
+// Panning (NR51) and master volume (NR50) are turned into lookup tables
+// when those registers are written, so mixing a frame is a few integer adds
+// and one table lookup per side.
+class Mixer {
+private:
+  int leftMasks[4];      // -1 if the channel goes to the left, else 0
+  int rightMasks[4];     // -1 if the channel goes to the right, else 0
+  float leftLevels[61];  // Output for every sum of channel inputs (0-60)
+  float rightLevels[61];
+
+public:
+  Mixer();
+
+  // Rebuild the tables, called whenever NR50 or NR51 change
+  void setRegisters(BYTE NR50, BYTE NR51);
+
+  void mix(const int outputs[4], float &left, float &right) const {
+    int leftSum = (outputs[0] & leftMasks[0]) + (outputs[1] & leftMasks[1]) +
+                  (outputs[2] & leftMasks[2]) + (outputs[3] & leftMasks[3]);
+    int rightSum = (outputs[0] & rightMasks[0]) +
+                   (outputs[1] & rightMasks[1]) +
+                   (outputs[2] & rightMasks[2]) + (outputs[3] & rightMasks[3]);
+    left = leftLevels[leftSum];
+    right = rightLevels[rightSum];
+  }
+};
+
+#endif // MIXER_H
@@ -1,4 +1,6 @@
 #include "channelFour.h"
+#include "../StateIO.h"
+#include <algorithm>
 
 ChannelFour::ChannelFour() {
   // Initialize the registers with default values
@@ -7,6 +9,7 @@ ChannelFour::ChannelFour() {
   NR43 = 0x00;
   NR44 = 0x00;
   channelEnabled = false;
+  state = ChannelState(); // Timers and counters start at zero
   state.dacEnabled = false;
   state.lfsr = 0;
 }
@@ -149,12 +152,7 @@ void ChannelFour::trigger() {
   state.lengthTimer = getInitialLengthTimer();
   // Set the LFSR width
   state.lfsrWidth = getLSFRWidth();
-  if (getClockDivider() == 0) {
-    // Handle 0 as 0.5
-    state.lfsrTimer = 16 * 0.5 * pow(2, getClockShift());
-  } else {
-    state.lfsrTimer = 16 * getClockDivider() * pow(2, getClockShift());
-  }
+  state.lfsrTimer = getLFSRPeriod();
   // Set the LFSR
   state.lfsr = 0;
   setEnabled(true);
@@ -172,9 +170,9 @@ void ChannelFour::reset() {
 }
 
 // Get the sample from Channel Four
-float ChannelFour::getSample() {
+int ChannelFour::getSample() {
   if (!state.dacEnabled || !isEnabled()) {
-    return 0.0f; // DAC disabled
+    return 0; // DAC disabled
   }
   // Use LFSR for waveform generation
   return (state.lfsr & 1) ? state.volume : 0; // Return volume if LFSR is high
@@ -212,36 +210,113 @@ void ChannelFour::updateEnvelope() {
   }
 }
 
-// Update the LFSR
-void ChannelFour::updateLFSR(int cycles) {
-  state.lfsrTimer -= cycles;
-  if (state.lfsrTimer <= 0) {
-    state.lfsrTimer = (16 * getClockDivider() * pow(2, getClockShift()));
-    // Update LFSR
+// LFSR timer
+int ChannelFour::getTimer() const { return state.lfsrTimer; }
+
+void ChannelFour::setTimer(int cycles) { state.lfsrTimer = cycles; }
+
+// Cycles between LFSR clocks, the divider (0 counts as 0.5) times 16
+// shifted left by the clock shift
+int ChannelFour::getLFSRPeriod() const {
+  static const int divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+  return divisors[getClockDivider()] << getClockShift();
+}
+
+// Clock the LFSR
+// Each clock XNORs bits 0 and 1 into bit 15 (and bit 7 in 7-bit mode) and
+// shifts right by one. Since new bits take 14 clocks (6 in 7-bit mode) to
+// reach bit 1, the next k clocks within that range can be done at once:
+// their feedback bits are ~(lfsr ^ lfsr >> 1) and their outputs are simply
+// the bits lfsr >> 1. Steps up to maxSteps times, stopping after the first
+// clock that changes the output bit unless the channel is silent anyway.
+// Returns the number of clocks taken.
+int ChannelFour::stepWaveform(int maxSteps) {
+  state.lfsrTimer = getLFSRPeriod();
+  bool silent = !state.dacEnabled || state.volume == 0;
+  int chunk = state.lfsrWidth ? 6 : 14;
+  unsigned int lfsr = state.lfsr;
+  int taken = 0;
+  while (taken < maxSteps) {
+    int steps = std::min(chunk, maxSteps - taken);
+    unsigned int mask = (1u << steps) - 1;
+    bool changed = false;
+    if (!silent) {
+      // Output bit after each clock, compared with the current one
+      unsigned int changes = ((lfsr >> 1) ^ ((lfsr & 1) ? mask : 0)) & mask;
+      if (changes) {
+        steps = __builtin_ctz(changes) + 1;
+        mask = (1u << steps) - 1;
+        changed = true;
+      }
+    }
+    unsigned int feedback = ~(lfsr ^ (lfsr >> 1)) & mask;
+    lfsr = (lfsr >> steps) | (feedback << (15 - steps));
     if (state.lfsrWidth) {
-      // 7-bit LFSR
-      // Perform an XNOR between bit 0 and bit 1,
-      // Store results in bit 15 and bit 7
-      // Then shift the LFSR to the right by 1
-      bool xnorResult =
-          !((state.lfsr & 1) ^ ((state.lfsr >> 1) & 1)); // XNOR bit 0 and bit 1
-      state.lfsr = state.lfsr | (xnorResult << 15) |
-                   (xnorResult << 7); // Store in bit 15 and bit 7
-      state.lfsr = (state.lfsr >> 1); // Shift right by 1
-    } else {
-      // 15-bit LFSR
-      // Perform an XNOR between bit 0 and bit 1,
-      // Store results in bit 15
-      // Then shift the LFSR to the right by 1
-      bool xnorResult =
-          !((state.lfsr & 1) ^ ((state.lfsr >> 1) & 1)); // XNOR bit 0 and bit 1
-      state.lfsr = state.lfsr | (xnorResult << 15);      // Store in bit 15
-      state.lfsr = (state.lfsr >> 1);                    // Shift right by 1
+      lfsr |= feedback << (7 - steps);
     }
+    taken += steps;
+    if (changed) {
+      break;
+    }
+  }
+  state.lfsr = lfsr;
+  return taken;
+}
+
+// Same as stepping every clock in the next cycles, for when nothing is heard
+void ChannelFour::skipWaveform(int cycles) {
+  if (state.lfsrTimer > cycles) {
+    state.lfsrTimer -= cycles;
+    return;
   }
+  int timer = state.lfsrTimer;
+  int period = getLFSRPeriod();
+  int steps = (cycles - timer) / period + 1;
+  stepWaveform(steps); // Silent, so it takes every step
+  state.lfsrTimer = timer + steps * period - cycles;
 }
 
 // Status functions
 bool ChannelFour::isEnabled() const { return channelEnabled; }
 void ChannelFour::setEnabled(bool enable) { channelEnabled = enable; }
-bool ChannelFour::isDacEnabled() const { return state.dacEnabled; }
\ No newline at end of file
+bool ChannelFour::isDacEnabled() const { return state.dacEnabled; }
+bool ChannelFour::isAudible() const {
+  return channelEnabled && state.dacEnabled && state.volume > 0;
+}
+
+void ChannelFour::saveState(StateWriter &writer) const {
+  writer.beginSection("CH4 ");
+  writer.put(NR41);
+  writer.put(NR42);
+  writer.put(NR43);
+  writer.put(NR44);
+  writer.put(state.lengthTimer);
+  writer.put(state.envelopeTimer);
+  writer.put(state.envelopePeriod);
+  writer.put(state.envelopeDirection);
+  writer.put(state.lfsrTimer);
+  writer.put(state.lfsrWidth);
+  writer.put(state.lfsr);
+  writer.put(state.volume);
+  writer.put(state.dacEnabled);
+  writer.put(channelEnabled);
+  writer.endSection();
+}
+
+void ChannelFour::loadState(StateReader &reader) {
+  reader.openSection("CH4 ");
+  reader.get(NR41);
+  reader.get(NR42);
+  reader.get(NR43);
+  reader.get(NR44);
+  reader.get(state.lengthTimer);
+  reader.get(state.envelopeTimer);
+  reader.get(state.envelopePeriod);
+  reader.get(state.envelopeDirection);
+  reader.get(state.lfsrTimer);
+  reader.get(state.lfsrWidth);
+  reader.get(state.lfsr);
+  reader.get(state.volume);
+  reader.get(state.dacEnabled);
+  reader.get(channelEnabled);
+}
\ No newline at end of file
@@ -2,12 +2,14 @@
 #define CHANNEL_FOUR_H
 
 #include <cstdint>
-#include <cmath>
 #include <iostream>
 
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class ChannelFour {
 private:
   // Channel State struct (moved from APU class)
@@ -95,14 +97,26 @@ public:
   // Channel operations
   void trigger();
   void reset();
-  float getSample();
+  int getSample(); // Current DAC input (0-15)
   void updateLengthTimer();
   void updateEnvelope();
-  void updateLFSR(int cycles);
+
+  // LFSR timer, stepped from one output change to the next by the APU
+  int getTimer() const;
+  void setTimer(int cycles);
+  int getLFSRPeriod() const; // Cycles between LFSR clocks
+  // Clock the LFSR up to maxSteps times, see channelFour.cpp
+  int stepWaveform(int maxSteps);
+  void skipWaveform(int cycles); // Advance over cycles while silent
 
   // Status functions
   bool isEnabled() const;
   void setEnabled(bool enable);
   bool isDacEnabled() const;
+  bool isAudible() const; // Enabled with a DAC and a volume above 0
+
+  // Save states
+  void saveState(StateWriter &writer) const;
+  void loadState(StateReader &reader);
 };
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "channelOne.h"
+#include "../StateIO.h"
 #include <cmath>
 #include <iostream>
 
@@ -10,6 +11,7 @@ ChannelOne::ChannelOne() {
   NR13 = 0x00;
   NR14 = 0xBF;
   channelEnabled = false;
+  state = ChannelState(); // Timers and counters start at zero
   state.dacEnabled = false;
 }
 
@@ -140,9 +142,9 @@ void ChannelOne::reset() {
   channelEnabled = false;
 }
 
-float ChannelOne::getSample() {
+int ChannelOne::getSample() {
   if (!state.dacEnabled || !isEnabled()) {
-    return 0.0f; // DAC disabled
+    return 0; // DAC disabled
   }
 
   static const int dutyTable[4][8] = {
@@ -156,17 +158,25 @@ float ChannelOne::getSample() {
   return duty ? state.volume : 0;
 }
 
-void ChannelOne::updateSequenceTimer(int cycles) {
-  if (!isEnabled()) {
-    return;
-  }
+int ChannelOne::getTimer() const { return state.timer; }
 
-  // Update the sequence timer
-  state.timer -= cycles;
-  if (state.timer <= 0) {
-    state.timer = (2048 - getPeriod()) * 4;
-    state.sequencePointer = (state.sequencePointer + 1) % 8;
+void ChannelOne::setTimer(int cycles) { state.timer = cycles; }
+
+void ChannelOne::stepWaveform() {
+  state.timer = (2048 - getPeriod()) * 4;
+  state.sequencePointer = (state.sequencePointer + 1) % 8;
+}
+
+// Same as stepping every edge in the next cycles, for when nothing is heard
+void ChannelOne::skipWaveform(int cycles) {
+  if (state.timer > cycles) {
+    state.timer -= cycles;
+    return;
   }
+  int period = (2048 - getPeriod()) * 4;
+  int steps = (cycles - state.timer) / period + 1;
+  state.sequencePointer = (state.sequencePointer + steps) % 8;
+  state.timer += steps * period - cycles;
 }
 
 void ChannelOne::updateLengthTimer() {
@@ -205,6 +215,49 @@ void ChannelOne::setEnabled(bool enable) { channelEnabled = enable; }
 
 bool ChannelOne::isDacEnabled() const { return state.dacEnabled; }
 
+bool ChannelOne::isAudible() const {
+  return channelEnabled && state.dacEnabled && state.volume > 0;
+}
+
+void ChannelOne::saveState(StateWriter &writer) const {
+  writer.beginSection("CH1 ");
+  writer.put(NR10);
+  writer.put(NR11);
+  writer.put(NR12);
+  writer.put(NR13);
+  writer.put(NR14);
+  writer.put(state.lengthTimer);
+  writer.put(state.envelopeTimer);
+  writer.put(state.envelopePeriod);
+  writer.put(state.envelopeDirection);
+  writer.put(state.timer);
+  writer.put(state.volume);
+  writer.put(state.sequencePointer);
+  writer.put(state.dacEnabled);
+  writer.put(state.sweepTimer);
+  writer.put(channelEnabled);
+  writer.endSection();
+}
+
+void ChannelOne::loadState(StateReader &reader) {
+  reader.openSection("CH1 ");
+  reader.get(NR10);
+  reader.get(NR11);
+  reader.get(NR12);
+  reader.get(NR13);
+  reader.get(NR14);
+  reader.get(state.lengthTimer);
+  reader.get(state.envelopeTimer);
+  reader.get(state.envelopePeriod);
+  reader.get(state.envelopeDirection);
+  reader.get(state.timer);
+  reader.get(state.volume);
+  reader.get(state.sequencePointer);
+  reader.get(state.dacEnabled);
+  reader.get(state.sweepTimer);
+  reader.get(channelEnabled);
+}
+
 // Channel One Sweep Specific functions (NR10)
 
 // A number 0-7 that sets the sweep pace
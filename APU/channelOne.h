@@ -6,6 +6,9 @@
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class ChannelOne {
 private:
   // Channel State struct (moved from APU class)
@@ -88,15 +91,25 @@ public:
   // Channel operations
   void trigger();
   void reset();
-  float getSample();
-  void updateSequenceTimer(int cycles);
+  int getSample(); // Current DAC input (0-15)
   void updateLengthTimer();
   void updateEnvelope();
 
+  // Waveform timer, stepped one edge at a time by the APU
+  int getTimer() const;
+  void setTimer(int cycles);
+  void stepWaveform(); // Reload the timer and advance the duty position
+  void skipWaveform(int cycles); // Advance over cycles while silent
+
   // Status functions
   bool isEnabled() const;
   void setEnabled(bool enable);
   bool isDacEnabled() const;
+  bool isAudible() const; // Enabled with a DAC and a volume above 0
+
+  // Save states
+  void saveState(StateWriter &writer) const;
+  void loadState(StateReader &reader);
 
   // Sweep functions
 
@@ -1,4 +1,6 @@
 #include "channelThree.h"
+#include "../StateIO.h"
+#include <cstring>
 
 ChannelThree::ChannelThree() {
   // Initialize the registers with default values
@@ -8,6 +10,8 @@ ChannelThree::ChannelThree() {
   NR33 = 0xBF;
   NR34 = 0x00;
   channelEnabled = false;
+  state = ChannelState(); // Timers and counters start at zero
+  memset(wavePatternRAM, 0, sizeof(wavePatternRAM));
   state.dacEnabled = false;
   state.sampleSelection = 1;
   state.sampleBuffer = 0.0f;
@@ -158,6 +162,45 @@ void ChannelThree::setEnabled(bool enable) {
 // Get the enabled state of the channel
 bool ChannelThree::isEnabled() const { return channelEnabled; }
 
+bool ChannelThree::isAudible() const {
+  return channelEnabled && state.dacEnabled && state.volume != 0;
+}
+
+void ChannelThree::saveState(StateWriter &writer) const {
+  writer.beginSection("CH3 ");
+  writer.put(NR30);
+  writer.put(NR31);
+  writer.put(NR32);
+  writer.put(NR33);
+  writer.put(NR34);
+  writer.put(state.lengthTimer);
+  writer.put(state.volume);
+  writer.put(state.dacEnabled);
+  writer.put(state.sampleSelection);
+  writer.put(state.sampleTimer);
+  writer.put(state.sampleBuffer);
+  writer.write(wavePatternRAM, sizeof(wavePatternRAM));
+  writer.put(channelEnabled);
+  writer.endSection();
+}
+
+void ChannelThree::loadState(StateReader &reader) {
+  reader.openSection("CH3 ");
+  reader.get(NR30);
+  reader.get(NR31);
+  reader.get(NR32);
+  reader.get(NR33);
+  reader.get(NR34);
+  reader.get(state.lengthTimer);
+  reader.get(state.volume);
+  reader.get(state.dacEnabled);
+  reader.get(state.sampleSelection);
+  reader.get(state.sampleTimer);
+  reader.get(state.sampleBuffer);
+  reader.read(wavePatternRAM, sizeof(wavePatternRAM));
+  reader.get(channelEnabled);
+}
+
 // Reset the channel
 void ChannelThree::reset() {
   NR30 = 0x7F;
@@ -172,15 +215,15 @@ void ChannelThree::reset() {
 }
 
 // Get the sample from Channel Three
-float ChannelThree::getSample() {
+int ChannelThree::getSample() {
   if (!state.dacEnabled || !isEnabled()) {
-    return 0.0f; // DAC disabled
+    return 0; // DAC disabled
   }
 
-  // Convert the shifted digital sample to an analog value (-1.0 to 1.0)
+  // Shift the digital sample by the output level
   int analogSample = state.sampleBuffer;
   if (state.volume == 0) {
-    return 0.0f; // If volume is 0, return 0
+    return 0; // If volume is 0, return 0
   } else if (state.volume == 7) {
     analogSample >>= 1; // If volume is 7, shift right by 1
   } else if (state.volume == 3) {
@@ -225,21 +268,31 @@ void ChannelThree::setWavePatternRAM(WORD address, BYTE value) {
 BYTE ChannelThree::getWavePatternRAM(WORD address) const {
   return wavePatternRAM[address & 0xF];
 }
-// Update the sample timer
-void ChannelThree::updateSampleTimer(int cycles) {
-  if (!isEnabled()) {
-    return; // If channel is disabled, do nothing
-  }
+// Sample timer
+int ChannelThree::getTimer() const { return state.sampleTimer; }
+
+void ChannelThree::setTimer(int cycles) { state.sampleTimer = cycles; }
+
+void ChannelThree::stepWaveform() {
+  state.sampleTimer = (2048 - getPeriod()) * 2; // Reset sample timer
+  state.sampleSelection =
+      (state.sampleSelection + 1) % 32; // Update sample selection
+  // Read the new sample and store it in the buffer
+  int sample = getNibbleWavePatternRAM(state.sampleSelection / 2,
+                                       (state.sampleSelection % 2 == 0));
+  state.sampleBuffer = sample;
+}
 
-  // Update the sample timer
-  state.sampleTimer -= cycles;
-  if (state.sampleTimer <= 0) {
-    state.sampleTimer = (2048 - getPeriod()) * 2; // Reset sample timer
-    state.sampleSelection =
-        (state.sampleSelection + 1) % 32; // Update sample selection
-    // Read the new sample and store it in the buffer
-    int sample = getNibbleWavePatternRAM(state.sampleSelection / 2,
-                                         (state.sampleSelection % 2 == 0));
-    state.sampleBuffer = sample;
+// Same as stepping every edge in the next cycles, for when nothing is heard
+void ChannelThree::skipWaveform(int cycles) {
+  if (state.sampleTimer > cycles) {
+    state.sampleTimer -= cycles;
+    return;
   }
+  int period = (2048 - getPeriod()) * 2;
+  int steps = (cycles - state.sampleTimer) / period + 1;
+  state.sampleSelection = (state.sampleSelection + steps) % 32;
+  state.sampleBuffer = getNibbleWavePatternRAM(state.sampleSelection / 2,
+                                               (state.sampleSelection % 2 == 0));
+  state.sampleTimer += steps * period - cycles;
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class ChannelThree {
 private:
   struct ChannelState {
@@ -77,8 +80,13 @@ public:
   void trigger();
   void setEnabled(bool enable);
   bool isEnabled() const;
+  bool isAudible() const; // Enabled with a DAC and not muted
+
+  // Save states
+  void saveState(StateWriter &writer) const;
+  void loadState(StateReader &reader);
   void reset();
-  float getSample();
+  int getSample(); // Current DAC input (0-15)
   void updateLengthTimer();
 
   // Wave Pattern RAM operations
@@ -86,7 +94,12 @@ public:
   BYTE getNibbleWavePatternRAM(int index, bool upper) const;
   void setWavePatternRAM(WORD address, BYTE value);
   BYTE getWavePatternRAM(WORD address) const;
-  void updateSampleTimer(int cycles);
+
+  // Sample timer, stepped one edge at a time by the APU
+  int getTimer() const;
+  void setTimer(int cycles);
+  void stepWaveform(); // Reload the timer and read the next sample
+  void skipWaveform(int cycles); // Advance over cycles while silent
 };
 
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "channelTwo.h"
+#include "../StateIO.h"
 
 ChannelTwo::ChannelTwo() {
   // Initialize the registers with default values from APU constructor
@@ -7,6 +8,7 @@ ChannelTwo::ChannelTwo() {
   NR23 = 0x00;
   NR24 = 0xBF;
   channelEnabled = false;
+  state = ChannelState(); // Timers and counters start at zero
   state.dacEnabled = false;
 }
 
@@ -163,9 +165,9 @@ void ChannelTwo::reset() {
 // Get the waveform sample in analog format
 // Returns a value between -1.0 and 1.0
 // 0.0 represents the middle of the waveform
-float ChannelTwo::getSample() {
+int ChannelTwo::getSample() {
   if (!state.dacEnabled || !isEnabled()) {
-    return 0.0f; // DAC disabled
+    return 0; // DAC disabled
   }
 
   // Use duty table for waveform lookup
@@ -180,19 +182,27 @@ float ChannelTwo::getSample() {
   return duty ? state.volume : 0; // Return volume if duty is high
 }
 
-// Update the sequence timer
-// This function is called every CPU cycle
-void ChannelTwo::updateSequenceTimer(int cycles) {
-  if (!isEnabled()) {
-    return; // If channel is disabled, do nothing
-  }
+// Waveform timer
+// The APU runs the timer down to the next edge and then calls stepWaveform
+int ChannelTwo::getTimer() const { return state.timer; }
+
+void ChannelTwo::setTimer(int cycles) { state.timer = cycles; }
 
-  // Update the sequence timer
-  state.timer -= cycles;
-  if (state.timer <= 0) {
-    state.timer = (2048 - getPeriod()) * 4; // Reset timer
-    state.sequencePointer = (state.sequencePointer + 1) % 8;
+void ChannelTwo::stepWaveform() {
+  state.timer = (2048 - getPeriod()) * 4; // Reset timer
+  state.sequencePointer = (state.sequencePointer + 1) % 8;
+}
+
+// Same as stepping every edge in the next cycles, for when nothing is heard
+void ChannelTwo::skipWaveform(int cycles) {
+  if (state.timer > cycles) {
+    state.timer -= cycles;
+    return;
   }
+  int period = (2048 - getPeriod()) * 4;
+  int steps = (cycles - state.timer) / period + 1;
+  state.sequencePointer = (state.sequencePointer + steps) % 8;
+  state.timer += steps * period - cycles;
 }
 
 // Update the length timer
@@ -235,4 +245,43 @@ bool ChannelTwo::isEnabled() const { return channelEnabled; }
 
 void ChannelTwo::setEnabled(bool enable) { channelEnabled = enable; }
 
-bool ChannelTwo::isDacEnabled() const { return state.dacEnabled; }
\ No newline at end of file
+bool ChannelTwo::isDacEnabled() const { return state.dacEnabled; }
+
+bool ChannelTwo::isAudible() const {
+  return channelEnabled && state.dacEnabled && state.volume > 0;
+}
+
+void ChannelTwo::saveState(StateWriter &writer) const {
+  writer.beginSection("CH2 ");
+  writer.put(NR21);
+  writer.put(NR22);
+  writer.put(NR23);
+  writer.put(NR24);
+  writer.put(state.lengthTimer);
+  writer.put(state.envelopeTimer);
+  writer.put(state.envelopePeriod);
+  writer.put(state.envelopeDirection);
+  writer.put(state.timer);
+  writer.put(state.volume);
+  writer.put(state.sequencePointer);
+  writer.put(state.dacEnabled);
+  writer.put(channelEnabled);
+  writer.endSection();
+}
+
+void ChannelTwo::loadState(StateReader &reader) {
+  reader.openSection("CH2 ");
+  reader.get(NR21);
+  reader.get(NR22);
+  reader.get(NR23);
+  reader.get(NR24);
+  reader.get(state.lengthTimer);
+  reader.get(state.envelopeTimer);
+  reader.get(state.envelopePeriod);
+  reader.get(state.envelopeDirection);
+  reader.get(state.timer);
+  reader.get(state.volume);
+  reader.get(state.sequencePointer);
+  reader.get(state.dacEnabled);
+  reader.get(channelEnabled);
+}
\ No newline at end of file
@@ -1,108 +1,218 @@
-#include "APU.h"
+// Offline audio renderer
+// Plays GBS music files headless (no SDL, nothing is drawn) as fast as
+// possible and writes each song to a WAV file, then reports how much faster
+// than real time the emulation ran.
+// An APU register log (from --log or ./gameboy --apu-log) is replayed
+// through the APU alone and written to PREFIX.wav, with the same samples
+// the original run produced at the same rate.
+// ./APU_emulator <file.gbs|file.gbl> [options]
+// Options:
+//   --song N       Render only song N (1 based, default all songs)
+//   --seconds S    Length of each song in seconds (default 120)
+//   --rate HZ      Output sample rate (default 44100)
+//   --out PREFIX   Songs are written to PREFIX-NN.wav (default: the input
+//                  path without its extension)
+//   --log          Also record the APU writes of each song to PREFIX-NN.gbl
+#include "../CPU.h"
+#include "../Cartridges/GBS.h"
+#include "../Memory.h"
+#include "../WAVWriter.h"
+#include "APULogPlayer.h"
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
 
-/*--------------CPU Simulation-------------*/
+using namespace std;
 
-int handleInstruction() {
-  return 4; // Return the number of cycles for the instruction executed
+// Passes every audio block straight to the WAV file
+class WAVSink : public AudioSink {
+public:
+  WAVWriter wav;
+  void queueSamples(const float *samples, int count) override {
+    wav.write(samples, count);
+  }
+};
+
+// Reads a GBS file into a new cartridge, nullptr on error
+GBS *loadGBS(const string &path) {
+  ifstream file(path, ios::binary | ios::ate);
+  if (!file.is_open()) {
+    cout << "Failed to open file: " << path << endl;
+    return nullptr;
+  }
+  unsigned int fileSize = file.tellg();
+  file.seekg(0, ios::beg);
+  uint8_t *fileData = (uint8_t *)malloc(fileSize);
+  file.read((char *)fileData, fileSize);
+  GBS *gbs = new GBS(fileData, fileSize); // Takes the file data
+  if (!gbs->isValid()) {
+    cout << "Not a valid GBS file: " << path << endl;
+    delete gbs;
+    return nullptr;
+  }
+  return gbs;
 }
 
-void cpuUpdate(APU &apu) {
-  const int MAXCYCLES = 69905;
-  int cyclesThisUpdate = 0;
+// Renders one song, returns the wall clock time taken or -1 on error
+double renderSong(const string &path, int song, double seconds, int rate,
+                  const string &outPath, const string &logPath) {
+  GBS *gbs = loadGBS(path);
+  if (gbs == nullptr) {
+    return -1;
+  }
+  gbs->selectSong(song);
+
+  Memory mainMem(gbs, false); // Memory now owns the cartridge
+  CPU CPU(mainMem);
+  CPU.resetGBNoBios();
+  mainMem.gpu->setFrameSkip(1 << 30); // Never draw
 
-  while (cyclesThisUpdate < MAXCYCLES) {
-    int cycles = handleInstruction();
-    cyclesThisUpdate += cycles;
-    /*-----------APU Controls--------------*/
-    apu.updateChannelTimers(cycles);
-    apu.apuStep(cycles);
-    apu.getAudioSample(cycles);
+  WAVSink sink;
+  if (!sink.wav.open(outPath, rate)) {
+    cout << "Failed to open file: " << outPath << endl;
+    return -1;
+  }
+  mainMem.setAudioFormat(rate, sampleSize);
+  mainMem.setAudioSink(&sink);
+  APULogWriter log;
+  if (!logPath.empty()) {
+    if (!log.open(logPath)) {
+      cout << "Failed to open file: " << logPath << endl;
+      return -1;
+    }
+    mainMem.setAPULog(&log);
   }
-}
-/*--------Channel Configs--------------*/
 
-void configureChannelOne(APU &apu, int initialVolume, int waveDuty, int period,
-                         int envelopePeriod, bool envelopeDirection,
-                         int lengthTimer, bool lengthEnable, int sweepPace,
-                         bool sweepDirection, int sweepStep) {
-  apu.channelOne.setInitialVolume(initialVolume);
-  apu.channelOne.setWaveDuty(waveDuty);
-  apu.channelOne.setPeriod(period);
-  apu.channelOne.setEnvelopePeriod(envelopePeriod);
-  apu.channelOne.setEnvelopeDirection(envelopeDirection);
-  apu.channelOne.setInitialLengthTimer(lengthTimer);
-  apu.channelOne.setLengthEnable(lengthEnable);
-  apu.channelOne.setSweepPace(sweepPace);
-  apu.channelOne.setSweepDirection(sweepDirection);
-  apu.channelOne.setSweepStep(sweepStep);
-  apu.channelOne.trigger();
+  long long cycles = (long long)(seconds * 4194304.0);
+  auto start = chrono::steady_clock::now();
+  while (cycles > 0) {
+    cycles -= CPU.step();
+  }
+  double wallSeconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  sink.wav.close();
+  mainMem.setAPULog(nullptr); // Records the time after the last write
+  log.close();
+  return wallSeconds;
 }
 
-void configureChannelTwo(APU &apu, int initialVolume, int waveDuty, int period,
-                         int envelopePeriod, bool envelopeDirection,
-                         int lengthTimer, bool lengthEnable) {
-  apu.channelTwo.setInitialVolume(initialVolume);
-  apu.channelTwo.setWaveDuty(waveDuty);
-  apu.channelTwo.setPeriod(period);
-  apu.channelTwo.setEnvelopePeriod(envelopePeriod);
-  apu.channelTwo.setEnvelopeDirection(envelopeDirection);
-  apu.channelTwo.setInitialLengthTimer(lengthTimer);
-  apu.channelTwo.setLengthEnable(lengthEnable);
-  apu.channelTwo.trigger();
-}
+// Replays a register log into a WAV file, returns 0 on success
+int renderLog(const string &path, int rate, const string &outPath) {
+  APULogPlayer player;
+  if (!player.load(path)) {
+    cout << "Failed to read APU log: " << path << endl;
+    return 1;
+  }
+  APU apu;
+  WAVSink sink;
+  if (!sink.wav.open(outPath, rate)) {
+    cout << "Failed to open file: " << outPath << endl;
+    return 1;
+  }
+  apu.setSampleRate(rate);
+  apu.setBlockSize(sampleSize);
+  apu.setAudioSink(&sink);
 
-void configureChannelThree(APU &apu, bool dacEnable, int lengthTimer,
-                           int outputLevel, int period, bool lengthEnable,
-                           const BYTE wavePattern[16]) {
-  apu.channelThree.setDACEnable(dacEnable);
-  apu.channelThree.setInitialLengthTimer(lengthTimer);
-  apu.channelThree.setOutputLevel(outputLevel);
-  apu.channelThree.setPeriod(period);
-  apu.channelThree.setLengthEnable(lengthEnable);
-  for (int i = 0; i < 16; i++) {
-    apu.channelThree.setWavePatternRAM(i, wavePattern[i]);
-  }
-  apu.channelThree.trigger();
-}
+  auto start = chrono::steady_clock::now();
+  double seconds = player.play(apu) / 4194304.0;
+  double wallSeconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  sink.wav.close();
 
-void configureChannelFour(APU &apu, int initialVolume, int envelopePeriod,
-                          bool envelopeDirection, int lengthTimer,
-                          bool lengthEnable, int clockShift, bool lfsrWidth,
-                          int clockDivider) {
-  apu.channelFour.setInitialVolume(initialVolume);
-  apu.channelFour.setEnvelopePeriod(envelopePeriod);
-  apu.channelFour.setEnvelopeDirection(envelopeDirection);
-  apu.channelFour.setInitialLengthTimer(lengthTimer);
-  apu.channelFour.setLengthEnable(lengthEnable);
-  apu.channelFour.setClockShift(clockShift);
-  apu.channelFour.setLSFRWidth(lfsrWidth);
-  apu.channelFour.setClockDivider(clockDivider);
-  apu.channelFour.trigger();
+  // Report the results
+  printf("Replayed: %s -> %s\n", path.c_str(), outPath.c_str());
+  printf("Audio:    %.1f s\n", seconds);
+  printf("Time:     %.3f s\n", wallSeconds);
+  printf("Speed:    %.1fx real time\n", seconds / wallSeconds);
+  printf("Skipped:  %llu silent channel runs\n",
+         (unsigned long long)apu.getSkippedUpdates());
+  return 0;
 }
 
-/*-------------Main-----------------*/
-
-int main() {
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cout << "Usage: " << argv[0]
+         << " file.gbs|file.gbl [--song N] [--seconds S] [--rate HZ]"
+            " [--out PREFIX] [--log]\n";
+    exit(-1);
+  }
+  string path = argv[1];
+  int onlySong = 0; // 1 based, 0 renders every song
+  double seconds = 120;
+  int rate = 44100;
+  string prefix = path.substr(0, path.find_last_of('.'));
+  bool writeLog = false;
+  bool launchError = false;
+  for (int i = 2; i < argc; i++) {
+    string arg = argv[i];
+    try {
+      if (arg == "--song" && i + 1 < argc) {
+        onlySong = stoi(argv[++i]);
+      } else if (arg == "--seconds" && i + 1 < argc) {
+        seconds = stod(argv[++i]);
+      } else if (arg == "--rate" && i + 1 < argc) {
+        rate = stoi(argv[++i]);
+      } else if (arg == "--out" && i + 1 < argc) {
+        prefix = argv[++i];
+      } else if (arg == "--log") {
+        writeLog = true;
+      } else {
+        launchError = true;
+      }
+    } catch (const logic_error &) { // invalid_argument or out_of_range
+      launchError = true;
+    }
+  }
+  if (launchError || seconds <= 0 || rate < 8000 || rate > 192000) {
+    cout << "Usage: " << argv[0]
+         << " file.gbs|file.gbl [--song N] [--seconds S] [--rate HZ]"
+            " [--out PREFIX] [--log]\n";
+    exit(-1);
+  }
 
-  APU apu;
-  apu.setAPUStatus(true); // Enable APU
-  apu.writeNR51(0x42);    // Configure channel panning
+  if (APULogPlayer::isLog(path)) {
+    return renderLog(path, rate, prefix + ".wav");
+  }
 
-  // Configure channels
-  configureChannelOne(apu, 0, 3, 1547, 0, false, 0, false, 7, false, 7);
-  configureChannelTwo(apu, 5, 3, 1547, 0, false, 0, false);
-  BYTE wavePattern[16] = {0};
-  for (int i = 0; i < 16; i++) {
-    wavePattern[i] =
-        (i < 8) ? 0xFF : 0x00; // Adjust as needed for your waveform
-  }
-  configureChannelThree(apu, true, 0, 3, 1547, false, wavePattern);
-  configureChannelFour(apu, 0, 7, false, 0, true, 0, true, 7);
+  GBS *info = loadGBS(path);
+  if (info == nullptr) {
+    exit(1);
+  }
+  int songCount = info->getSongCount();
+  printf("Title:     %s\n", info->getTitle().c_str());
+  printf("Author:    %s\n", info->getAuthor().c_str());
+  printf("Copyright: %s\n", info->getCopyright().c_str());
+  printf("Songs:     %d (%s driven)\n", songCount,
+         info->usesTimer() ? "timer" : "VBlank");
+  delete info;
+  if (onlySong < 0 || onlySong > songCount) {
+    cout << "Song " << onlySong << " out of range" << endl;
+    exit(1);
+  }
 
-  // Main loop
-  for (int i = 0; i < 200; i++) {
-    cpuUpdate(apu);
+  int first = onlySong > 0 ? onlySong : 1;
+  int last = onlySong > 0 ? onlySong : songCount;
+  double totalWall = 0;
+  for (int song = first; song <= last; song++) {
+    char number[16];
+    snprintf(number, sizeof(number), "-%02d", song);
+    string outPath = prefix + number + ".wav";
+    string logPath = writeLog ? prefix + number + ".gbl" : "";
+    double wall = renderSong(path, song - 1, seconds, rate, outPath, logPath);
+    if (wall < 0) {
+      exit(1);
+    }
+    totalWall += wall;
+    printf("Song %2d -> %s (%.3f s, %.1fx real time)\n", song,
+           outPath.c_str(), wall, seconds / wall);
   }
 
+  // Report the results
+  int songs = last - first + 1;
+  printf("Rendered: %d songs, %.1f s of audio\n", songs, songs * seconds);
+  printf("Time:     %.3f s\n", totalWall);
+  printf("Speed:    %.1fx real time\n", songs * seconds / totalWall);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,78 @@
+#ifndef AUDIORING_H
+#define AUDIORING_H
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// Lock-free single producer / single consumer ring of audio samples.
+// The emulation thread writes whatever it produced and the audio callback
+// reads whatever it needs; neither side ever waits. Writes that do not fit
+// are dropped (an overrun) and reads that find too little are padded with
+// silence (an underrun). Size must be a power of two.
+template <unsigned int Size> class AudioRing {
+private:
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+  float samples[Size];
+  // Kept on separate cache lines so the two threads do not fight over them
+  alignas(64) std::atomic<unsigned int> head; // Next sample to read
+  alignas(64) std::atomic<unsigned int> tail; // Next sample to write
+  std::atomic<uint64_t> underruns;
+  std::atomic<uint64_t> overruns;
+
+public:
+  AudioRing() : head(0), tail(0), underruns(0), overruns(0) {}
+
+  // Producer side, returns the number of samples written
+  int write(const float *data, int count) {
+    unsigned int t = tail.load(std::memory_order_relaxed);
+    int space = Size - (t - head.load(std::memory_order_acquire));
+    if (count > space) {
+      overruns.fetch_add(1, std::memory_order_relaxed);
+      count = space;
+    }
+    // Copy in up to two pieces around the end of the ring
+    unsigned int start = t & (Size - 1);
+    int first = std::min(count, (int)(Size - start));
+    memcpy(samples + start, data, first * sizeof(float));
+    memcpy(samples, data + first, (count - first) * sizeof(float));
+    tail.store(t + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer side, always fills count samples, padding with silence
+  void read(float *data, int count) {
+    unsigned int h = head.load(std::memory_order_relaxed);
+    unsigned int t = tail.load(std::memory_order_acquire);
+    int available = t - h;
+    int copied = std::min(count, available);
+    unsigned int start = h & (Size - 1);
+    int first = std::min(copied, (int)(Size - start));
+    memcpy(data, samples + start, first * sizeof(float));
+    memcpy(data + first, samples, (copied - first) * sizeof(float));
+    head.store(h + copied, std::memory_order_release);
+    if (copied < count) {
+      memset(data + copied, 0, (count - copied) * sizeof(float));
+      // Running dry before anything was written is just start up
+      if (t != 0) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Samples waiting to be read, safe to call from either side
+  int getQueued() const {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+  int getCapacity() const { return Size; }
+  uint64_t getUnderruns() const {
+    return underruns.load(std::memory_order_relaxed);
+  }
+  uint64_t getOverruns() const {
+    return overruns.load(std::memory_order_relaxed);
+  }
+};
+
+#endif
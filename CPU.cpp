@@ -1,5 +1,6 @@
 // #include "stdafx.h"
 #include "CPU.h"
+#include "StateIO.h"
 // Flag Register constants
 #define flagZset 0x80
 #define flagNset 0x40
@@ -58,6 +59,9 @@ CPU::CPU(Memory &mainMem) : mainMem(&mainMem) {
   IME = false;
   IMEhold = false;
   halt = false;
+  doubleSpeed = false;
+  cycleCounter = 0;
+  lastCycleCount = 0;
 }
 
 CPU::~CPU() {}
@@ -1883,8 +1887,68 @@ uint8_t CPU::RES(uint8_t input, int bit) {
 
 bool CPU::getDoubleSpeed() { return doubleSpeed; }
 
+int CPU::step() {
+  executeOneInstruction();
+  int cycles = doubleSpeed ? lastCycleCount / 2 : lastCycleCount;
+  mainMem->updateCycles(cycles);
+  mainMem->updateTimers(lastCycleCount); // Timers run at the CPU's speed
+  return cycles;
+}
+
+void CPU::runFrame() {
+  while (!mainMem->gpu->vBlank) {
+    step();
+  }
+  mainMem->gpu->vBlank = false;
+}
+
 void CPU::test() {
   mainMem->writeByteNoProtect(0x100, 0xCB);
   mainMem->writeByteNoProtect(0x101, 0x56);
   executeOneInstruction();
-}
\ No newline at end of file
+}
+
+void CPU::saveState(StateWriter &state) const {
+  state.beginSection("CPU ");
+  state.put(reg_A);
+  state.put(reg_F);
+  state.put(reg_B);
+  state.put(reg_C);
+  state.put(reg_D);
+  state.put(reg_E);
+  state.put(reg_H);
+  state.put(reg_L);
+  state.put(reg_PC);
+  state.put(reg_SP);
+  state.put(IME);
+  state.put(IMEhold);
+  state.put(EIDIFlag);
+  state.put(halt);
+  state.put(doubleSpeed);
+  state.put(cycleCounter);
+  state.put(lastCycleCount);
+  state.put(instructCount);
+  state.endSection();
+}
+
+void CPU::loadState(StateReader &state) {
+  state.openSection("CPU ");
+  state.get(reg_A);
+  state.get(reg_F);
+  state.get(reg_B);
+  state.get(reg_C);
+  state.get(reg_D);
+  state.get(reg_E);
+  state.get(reg_H);
+  state.get(reg_L);
+  state.get(reg_PC);
+  state.get(reg_SP);
+  state.get(IME);
+  state.get(IMEhold);
+  state.get(EIDIFlag);
+  state.get(halt);
+  state.get(doubleSpeed);
+  state.get(cycleCounter);
+  state.get(lastCycleCount);
+  state.get(instructCount);
+}
@@ -3,6 +3,9 @@
 #include "Memory.h"
 #include "stdint.h"
 
+class StateWriter;
+class StateReader;
+
 class CPU {
 public:
   CPU(Memory &mainMem);
@@ -11,6 +14,12 @@ public:
   void resetGBBios();
   void resetCGBNoBios();
   void executeOneInstruction();
+  // Run one instruction and clock the rest of the machine along, returns
+  // the cycles of the 4.194304 MHz clock that passed (half the CPU's cycles
+  // in double speed)
+  int step();
+  // Run until the GPU reaches VBlank, the frame is then complete
+  void runFrame();
   // void resetGBWithBios();
   void test();
   // Cycle count constants
@@ -22,6 +31,10 @@ public:
   // CGB stuff
   bool getDoubleSpeed();
 
+  // Save states, see SaveState.h
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+
 private:
   // Thing
   uint64_t instructCount = 0;
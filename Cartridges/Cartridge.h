@@ -8,6 +8,9 @@
 
 using namespace std;
 
+class StateWriter;
+class StateReader;
+
 
 class Cartridge
 {
@@ -20,6 +23,12 @@ public:
 
 	virtual void setBatteryLocation(string batteryPath) = 0;
 	virtual void saveBatteryData() = 0;
+	// Cartridges with a clock follow the system time, off it stands still
+	virtual void setRealTimeClock(bool) {}
+
+	// Save states, the banking registers and RAM in a "CART" section
+	virtual void saveState(StateWriter& state) const = 0;
+	virtual void loadState(StateReader& state) = 0;
 
 	static bool loadBatteryFile(uint8_t* extRAm, unsigned int ramSize, string inBatteryPath);
 	static void saveBatteryFile(uint8_t* extRAM, unsigned int ramSize, string inBatteryPath);
@@ -0,0 +1,137 @@
+#include "GBS.h"
+#include "../StateIO.h"
+#include <cstdlib>
+#include <cstring>
+
+// Header layout (0x70 bytes, little endian):
+//   0x00 "GBS", 0x03 version, 0x04 song count, 0x05 first song (1 based),
+//   0x06 load, 0x08 init, 0x0A play, 0x0C stack pointer,
+//   0x0E timer modulo, 0x0F timer control, 0x10 title, 0x30 author,
+//   0x50 copyright (32 bytes each, zero padded)
+static const unsigned int headerSize = 0x70;
+
+static string headerString(const uint8_t *data) {
+  return string((const char *)data, strnlen((const char *)data, 32));
+}
+
+GBS::GBS(uint8_t *fileData, unsigned int fileSize) {
+  memset(ram, 0, sizeof(ram));
+  if (fileSize < headerSize || memcmp(fileData, "GBS", 3) != 0 ||
+      fileData[3] != 1) {
+    free(fileData);
+    return;
+  }
+  songCount = fileData[0x04];
+  firstSong = fileData[0x05] > 0 ? fileData[0x05] - 1 : 0;
+  loadAddress = fileData[0x06] | (fileData[0x07] << 8);
+  initAddress = fileData[0x08] | (fileData[0x09] << 8);
+  playAddress = fileData[0x0A] | (fileData[0x0B] << 8);
+  stackPointer = fileData[0x0C] | (fileData[0x0D] << 8);
+  timerModulo = fileData[0x0E];
+  timerControl = fileData[0x0F];
+  title = headerString(fileData + 0x10);
+  author = headerString(fileData + 0x30);
+  copyright = headerString(fileData + 0x50);
+
+  // The driver needs the space below 0x400
+  unsigned int dataSize = fileSize - headerSize;
+  if (loadAddress < 0x400 || loadAddress + dataSize > 0x400000) {
+    free(fileData);
+    return;
+  }
+
+  // Whole 16 KB banks, rounded up to a power of two for masking
+  unsigned int banks = 2;
+  while (banks * 0x4000 < loadAddress + dataSize) {
+    banks *= 2;
+  }
+  romSize = banks * 0x4000;
+  rom = (uint8_t *)calloc(romSize, 1);
+  memcpy(rom + loadAddress, fileData + headerSize, dataSize);
+  free(fileData);
+
+  writeDriver(firstSong);
+  valid = true;
+}
+
+GBS::~GBS() { free(rom); }
+
+void GBS::selectSong(int song) {
+  if (valid) {
+    writeDriver(song);
+  }
+}
+
+void GBS::writeDriver(int song) {
+  memset(rom, 0, 0x400);
+  // RST vectors jump into the music data
+  for (int vector = 0; vector < 0x40; vector += 8) {
+    uint16_t target = loadAddress + vector;
+    uint8_t jump[] = {0xC3, (uint8_t)target, (uint8_t)(target >> 8)}; // JP
+    memcpy(rom + vector, jump, sizeof(jump));
+  }
+  // VBlank and timer interrupts call play
+  uint8_t callPlay[] = {0xCD, (uint8_t)playAddress,
+                        (uint8_t)(playAddress >> 8), // CALL play
+                        0xD9};                       // RETI
+  memcpy(rom + 0x40, callPlay, sizeof(callPlay));
+  memcpy(rom + 0x50, callPlay, sizeof(callPlay));
+
+  uint8_t main[] = {
+      0xF3,                                                  // DI
+      0x31, (uint8_t)stackPointer, (uint8_t)(stackPointer >> 8), // LD SP,nn
+      0x3E, timerModulo, 0xE0, 0x06,                         // TMA
+      0x3E, (uint8_t)(timerControl & 0x07), 0xE0, 0x07,      // TAC
+      0x3E, 0x80, 0xE0, 0x26,                                // NR52, APU on
+      0x3E, 0x77, 0xE0, 0x24,                                // NR50
+      0x3E, 0xFF, 0xE0, 0x25,                                // NR51
+      0x3E, (uint8_t)song,                                   // LD A,song
+      0xCD, (uint8_t)initAddress, (uint8_t)(initAddress >> 8), // CALL init
+      0x3E, (uint8_t)(usesTimer() ? 0x04 : 0x01), 0xE0, 0xFF, // IE
+      0xAF, 0xE0, 0x0F,                                      // Clear IF
+      0xFB,                                                  // EI
+      0x76,                                                  // HALT
+      0x18, 0xFD                                             // JR -3
+  };
+  memcpy(rom + 0x100, main, sizeof(main));
+  romBankNumber = 1;
+}
+
+void GBS::writeData(uint16_t address, uint8_t data) {
+  if (address >= 0x2000 && address <= 0x3FFF) {
+    // ROM Bank Number, 0 selects bank 1
+    romBankNumber = data == 0 ? 1 : data;
+  } else if (address >= 0xA000 && address <= 0xBFFF) {
+    ram[address & 0x1FFF] = data;
+  }
+}
+
+uint8_t GBS::readData(uint16_t address) {
+  if (address <= 0x3FFF) {
+    return rom[address];
+  } else if (address <= 0x7FFF) {
+    uint32_t romAddress = (address & 0x3FFF) | (romBankNumber << 14);
+    return rom[romAddress & (romSize - 1)];
+  } else if (address >= 0xA000 && address <= 0xBFFF) {
+    return ram[address & 0x1FFF];
+  }
+  return 0xFF;
+}
+
+void GBS::setBatteryLocation(string) {}
+
+void GBS::saveBatteryData() {}
+
+// The driver belongs to the selected song and is not part of the state
+void GBS::saveState(StateWriter &state) const {
+  state.beginSection("CART");
+  state.put(romBankNumber);
+  state.write(ram, sizeof(ram));
+  state.endSection();
+}
+
+void GBS::loadState(StateReader &state) {
+  state.openSection("CART");
+  state.get(romBankNumber);
+  state.read(ram, sizeof(ram));
+}
@@ -0,0 +1,64 @@
+#ifndef GBS_H
+#define GBS_H
+#include "Cartridge.h"
+
+// A GBS music file mapped as a cartridge.
+// The music data is placed at its load address in a banked ROM image
+// (bank switching by writes to 0x2000-0x3FFF, like MBC1) with 8 KB of RAM.
+// The unused space below the load address holds a small driver:
+//   0x0100  set SP, TMA and TAC, turn the APU on, call init with the song
+//           number in A, enable the VBlank or timer interrupt and HALT
+//   0x0040  VBlank vector, calls play
+//   0x0050  Timer vector, calls play
+//   RST xx  jump to load address + xx, as the format requires
+// Running the CPU from 0x100 therefore plays the song.
+class GBS :
+	public Cartridge
+{
+public:
+	GBS(uint8_t* fileData, unsigned int fileSize);
+	~GBS();
+
+	void writeData(uint16_t address, uint8_t data) override;
+	uint8_t readData(uint16_t address) override;
+
+	// Battery functions, GBS files have no saves
+	void setBatteryLocation(string batteryPath) override;
+	void saveBatteryData() override;
+
+	// Save states
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
+
+	bool isValid() const { return valid; }
+	void selectSong(int song); // 0 based, rewrites the driver
+
+	// Header information
+	int getSongCount() const { return songCount; }
+	int getFirstSong() const { return firstSong; } // 0 based
+	const string& getTitle() const { return title; }
+	const string& getAuthor() const { return author; }
+	const string& getCopyright() const { return copyright; }
+	bool usesTimer() const { return (timerControl & 0x04) != 0; }
+
+private:
+	bool valid = false;
+	uint8_t* rom = nullptr;
+	unsigned int romSize = 0;
+	uint8_t ram[0x2000];
+	uint16_t romBankNumber = 1;
+
+	int songCount = 0;
+	int firstSong = 0;
+	uint16_t loadAddress = 0;
+	uint16_t initAddress = 0;
+	uint16_t playAddress = 0;
+	uint16_t stackPointer = 0;
+	uint8_t timerModulo = 0;
+	uint8_t timerControl = 0;
+	string title, author, copyright;
+
+	void writeDriver(int song);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "MBC1.h"
+#include "../StateIO.h"
 
 MBC1::MBC1(uint8_t *romData, unsigned int romSize, unsigned int ramSize)
     : rom(romData), romSize(romSize), ramSize(ramSize) {
@@ -11,7 +12,7 @@ MBC1::~MBC1() {
     saveBatteryData();
   }
   free(rom);
-  free(ram);
+  delete[] ram;
 }
 
 void MBC1::writeData(uint16_t address, uint8_t data) {
@@ -115,3 +116,23 @@ void MBC1::saveBatteryData() {
     ramNewData = false;
   }
 }
+
+void MBC1::saveState(StateWriter &state) const {
+  state.beginSection("CART");
+  state.put(ramEnable);
+  state.put(romBankNumber);
+  state.put(romRamBankNumber);
+  state.put(romRamMode);
+  state.write(ram, ramSize);
+  state.endSection();
+}
+
+void MBC1::loadState(StateReader &state) {
+  state.openSection("CART");
+  state.get(ramEnable);
+  state.get(romBankNumber);
+  state.get(romRamBankNumber);
+  state.get(romRamMode);
+  state.read(ram, ramSize);
+  ramNewData = battery; // The loaded RAM has not been saved yet
+}
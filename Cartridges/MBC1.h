@@ -23,6 +23,10 @@ public:
   void setBatteryLocation(string batteryPath) override;
   void saveBatteryData() override;
 
+  // Save states
+  void saveState(StateWriter &state) const override;
+  void loadState(StateReader &state) override;
+
 private:
 
   // Private variables and classes
@@ -1,4 +1,5 @@
 #include "MBC3.h"
+#include "../StateIO.h"
 
 MBC3::MBC3(uint8_t *romData, unsigned int romSize, unsigned int ramSize,
            bool timerPresent)
@@ -12,7 +13,7 @@ MBC3::~MBC3() {
     saveBatteryData();
   }
   free(rom);
-  free(ram);
+  delete[] ram;
 }
 
 void MBC3::writeData(uint16_t address, uint8_t data) {
@@ -196,6 +197,8 @@ void MBC3::saveBatteryData() {
 }
 
 void MBC3::updateTimer() {
+  if (!realTimeClock) return;
+
   // Get the current system time
   time_t newTime = time(nullptr);
   
@@ -255,3 +258,50 @@ void MBC3::latchTimer() {
   latchDays = realDays;
   latchDaysHi = realDaysHi;
 }
+
+// The clock registers are saved as they were last updated together with the
+// system time of that update, so the clock catches up on the time since the
+// save just like it does for a battery file
+void MBC3::saveState(StateWriter &state) const {
+  state.beginSection("CART");
+  state.put(ramEnable);
+  state.put(romBankNumber);
+  state.put(RAMRTCSelect);
+  state.write(ram, ramSize);
+  state.put(realSecs);
+  state.put(realMins);
+  state.put(realHours);
+  state.put(realDays);
+  state.put(realDaysHi);
+  state.put(latchSecs);
+  state.put(latchMins);
+  state.put(latchHours);
+  state.put(latchDays);
+  state.put(latchDaysHi);
+  state.put(latch);
+  state.put((int64_t)currentTime);
+  state.endSection();
+}
+
+void MBC3::loadState(StateReader &state) {
+  state.openSection("CART");
+  state.get(ramEnable);
+  state.get(romBankNumber);
+  state.get(RAMRTCSelect);
+  state.read(ram, ramSize);
+  state.get(realSecs);
+  state.get(realMins);
+  state.get(realHours);
+  state.get(realDays);
+  state.get(realDaysHi);
+  state.get(latchSecs);
+  state.get(latchMins);
+  state.get(latchHours);
+  state.get(latchDays);
+  state.get(latchDaysHi);
+  state.get(latch);
+  int64_t savedTime;
+  state.get(savedTime);
+  currentTime = (time_t)savedTime;
+  ramNewData = battery; // The loaded RAM has not been saved yet
+}
@@ -15,6 +15,11 @@ public:
 	// Battery functions
 	void setBatteryLocation(string batteryPath) override;
 	void saveBatteryData() override;
+	void setRealTimeClock(bool enable) override { realTimeClock = enable; }
+
+	// Save states
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
 
 private:
 	uint8_t* rom;
@@ -46,6 +51,7 @@ private:
 	uint8_t latchDaysHi = 0;
 	
 	time_t currentTime = 0;
+	bool realTimeClock = true; // False keeps the clock where it is
 
 	bool latch = false;
 
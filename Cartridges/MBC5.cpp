@@ -1,4 +1,5 @@
 #include "MBC5.h"
+#include "../StateIO.h"
 
 MBC5::MBC5(uint8_t *romData, unsigned int romSize, unsigned int ramSize)
     : rom(romData), romSize(romSize), ramSize(ramSize) {
@@ -11,7 +12,7 @@ MBC5::~MBC5() {
     saveBatteryData();
   }
   free(rom);
-  free(ram);
+  delete[] ram;
 }
 
 void MBC5::writeData(uint16_t address, uint8_t data) {
@@ -82,3 +83,21 @@ void MBC5::saveBatteryData() {
     ramNewData = false;
   }
 }
+
+void MBC5::saveState(StateWriter &state) const {
+  state.beginSection("CART");
+  state.put(ramEnable);
+  state.put(romBankNumber);
+  state.put(ramBankNumber);
+  state.write(ram, ramSize);
+  state.endSection();
+}
+
+void MBC5::loadState(StateReader &state) {
+  state.openSection("CART");
+  state.get(ramEnable);
+  state.get(romBankNumber);
+  state.get(ramBankNumber);
+  state.read(ram, ramSize);
+  ramNewData = battery; // The loaded RAM has not been saved yet
+}
@@ -16,6 +16,10 @@ public:
 	void setBatteryLocation(string batteryPath) override;
 	void saveBatteryData() override;
 
+	// Save states
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
+
 private:
 	uint8_t* rom;
 	unsigned int romSize;
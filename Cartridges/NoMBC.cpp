@@ -1,12 +1,10 @@
-#include "NOMBC.h"
+#include "NoMBC.h"
+#include "../StateIO.h"
 
 
 
 NOMBC::NOMBC(uint8_t* romData, int romSize): romData(romData), romSize(romSize)
 {
-	if (romSize > 0x8000) {
-		cout << "ROM too large for NOMBC. We'll mask out but it will likely fail";
-	}
 }
 
 
@@ -32,3 +30,15 @@ void NOMBC::setBatteryLocation(string inBatteryPath)
 void NOMBC::saveBatteryData()
 {
 }
+
+// No registers or RAM, the section is only there to be found
+void NOMBC::saveState(StateWriter& state) const
+{
+	state.beginSection("CART");
+	state.endSection();
+}
+
+void NOMBC::loadState(StateReader& state)
+{
+	state.openSection("CART");
+}
@@ -12,6 +12,10 @@ public:
   void setBatteryLocation(string batteryPath) override;
   void saveBatteryData() override;
 
+  // Save states
+  void saveState(StateWriter &state) const override;
+  void loadState(StateReader &state) override;
+
 private:
   uint8_t *romData;
   unsigned int romSize;
@@ -0,0 +1,65 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+#include <cstdint>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+
+// Interfaces the emulation core uses to talk to the outside world.
+// The core never depends on a specific library, a frontend (SDL, headless,
+// tests) implements these and hands them to Memory.
+
+// Button bits reported by an InputSource, a set bit means the button is held
+enum Button {
+  BUTTON_RIGHT = 0x01,
+  BUTTON_LEFT = 0x02,
+  BUTTON_UP = 0x04,
+  BUTTON_DOWN = 0x08,
+  BUTTON_A = 0x10,
+  BUTTON_B = 0x20,
+  BUTTON_SELECT = 0x40,
+  BUTTON_START = 0x80
+};
+
+// Pixel formats a VideoSink can ask for
+enum PixelFormat {
+  PIXEL_XRGB8888, // 32 bits per pixel
+  PIXEL_RGB565,   // 16 bits per pixel
+  PIXEL_GRAY8     // 8 bits per pixel, luminance
+};
+
+// Receives completed frames from the GPU
+class VideoSink {
+public:
+  virtual ~VideoSink() {}
+  // Format the frames are converted to before they are presented
+  virtual PixelFormat getPixelFormat() const { return PIXEL_XRGB8888; }
+  // pixels is a 160x144 frame in the sink's pixel format, pitch is the
+  // number of bytes per row
+  virtual void presentFrame(const void *pixels, int pitch) = 0;
+};
+
+// Receives mixed audio from the APU
+class AudioSink {
+public:
+  virtual ~AudioSink() {}
+  // samples are interleaved stereo floats (left, right), count is the number
+  // of floats in the block
+  virtual void queueSamples(const float *samples, int count) = 0;
+};
+
+// Provides the state of the buttons to the joypad register
+class InputSource {
+public:
+  virtual ~InputSource() {}
+  virtual BYTE getButtons() = 0; // Bitmask of Button values
+};
+
+// Reports whatever buttons were last stored in it
+class HeldButtons : public InputSource {
+public:
+  BYTE buttons = 0;
+  BYTE getButtons() override { return buttons; }
+};
+
+#endif
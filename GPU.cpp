@@ -1,11 +1,17 @@
 #include "GPU.h"
+#include "LayerCache.h"
+#include "PixelConverter.h"
+#include "StateIO.h"
 #include "Memory.h"
+#include "ThreadPool.h"
 #include <cstdint>
 #include <iostream>
+#include <algorithm>
+#include <thread>
 
 GPU::GPU(Interrupts *interrupts, bool CGB, Memory *memory)
-    : interrupts(interrupts), cycleCount(0), CGB(CGB), vBlank(false),
-      memory(memory) {
+    : interrupts(interrupts), cycleCount(0), CGB(CGB), videoSink(nullptr),
+      vBlank(false), memory(memory) {
   // Initialize GPU registers
   LCDC = 0x91;
   LY = 0x00;
@@ -19,6 +25,9 @@ GPU::GPU(Interrupts *interrupts, bool CGB, Memory *memory)
   OBP0 = 0xFF; // Default object palette 0
   OBP1 = 0xFF; // Default object palette 1
 
+  memset(VRAM, 0, sizeof(VRAM));
+  memset(OAM, 0, sizeof(OAM));
+  memset(visiableSprites, 0, sizeof(visiableSprites));
   windowLine = 0;  // Initialize window line
   spriteCount = 0; // Initialize sprite count
 
@@ -33,10 +42,53 @@ GPU::GPU(Interrupts *interrupts, bool CGB, Memory *memory)
   }
   BCPS = 0x00; // Background Palette Specification
   OCPS = 0x00; // Object Palette Specification
-  backgroundGlobal = SDL_CreateRGBSurface(0, 160, 144, 32, 0, 0, 0, 0);
+
+  // No HDMA transfer running
+  HDMALength = 0;
+  HDMASource = 0;
+  HDMADest = 0;
+  HDMAActive = false;
+
+  // Frame hashing is off by default
+  frameHashing = false;
+  frameHash = 0;
+
+  // Frame skipping is disabled by default
+  frameSkip = 0;
+  frameSkipCounter = 0;
+  skipFrame = false;
+  skipRequested = false;
+  framesRendered = 0;
+  framesSkipped = 0;
+
+  // Sprite lines are built on the first OAM search
+  memset(bucketCounts, 0, sizeof(bucketCounts));
+  memset(bucketDirty, true, sizeof(bucketDirty));
+  bucketsDirty = true;
+  bucketHeight = 8;
+
+  // Deferred rendering is off by default
+  deferredRequested = false;
+  deferredActive = false;
+  deferredThreads = 0;
+  renderPool = nullptr;
+
+  // Background and window layers are cached by default
+  layerCache = new LayerCache(CGB);
+  // Start with a blank frame
+  memset(indexBuffer, 0x40, sizeof(indexBuffer));
+  memset(linePalettes, 0, sizeof(linePalettes));
+  memset(frameBuffer, 0, sizeof(frameBuffer));
+  frameConverted = true;
+  xrgbConverter = new PixelConverter(PIXEL_XRGB8888);
+  sinkConverter = nullptr;
 }
 GPU::~GPU() {
   // Destructor
+  delete renderPool;
+  delete layerCache;
+  delete xrgbConverter;
+  delete sinkConverter;
 }
 
 void GPU::writeData(WORD address, BYTE value) {
@@ -51,11 +103,33 @@ void GPU::writeData(WORD address, BYTE value) {
     }
 
     VRAM[offset] = value;
+    if (layerCache) {
+      layerCache->tileWritten(offset);
+    }
+    if (deferredActive) {
+      writeLog.push_back({offset, (WORD)lineLog.size(), value});
+    }
     return;
   }
   // Handle OAM writes
   else if (address >= 0xFE00 && address < 0xFEA0) {
-    OAM[address & 0xFF] = value;
+    BYTE index = address & 0xFF;
+    BYTE oldValue = OAM[index];
+    OAM[index] = value;
+    // Only Y and (for DMG priority) X change which lines a sprite is on or
+    // its order there, OAM DMA usually rewrites the same values
+    if (oldValue != value) {
+      if ((index & 0x03) == 0) {
+        invalidateSpriteRows(oldValue);
+        invalidateSpriteRows(value);
+      } else if ((index & 0x03) == 1 && !CGB) {
+        invalidateSpriteRows(OAM[index - 1]);
+      }
+    }
+    if (deferredActive) {
+      writeLog.push_back(
+          {(WORD)(0x4000 + (address & 0xFF)), (WORD)lineLog.size(), value});
+    }
     return;
   }
 
@@ -207,10 +281,23 @@ void GPU::advanceMode() {
         if (STAT & 0x10) interrupts->setLCDStatFlag(true);
         interrupts->setVBlankFlag(true);
         vBlank = true;
+        if (skipFrame) {
+          framesSkipped++;
+        } else {
+          if (deferredActive) {
+            renderDeferredFrame(); // Draw the recorded lines
+          }
+          if (frameHashing) {
+            frameHash = hashFrame();
+          }
+          framesRendered++;
+        }
       } else {
         STAT = (STAT & 0xFC) | 0x02; // Mode 2 (OAM Search)
         if (STAT & 0x20) interrupts->setLCDStatFlag(true);
-        findSprites(); // Search for sprites on this line
+        if (!skipFrame) {
+          findSprites(); // Search for sprites on this line
+        }
       }
       break;
       
@@ -223,7 +310,10 @@ void GPU::advanceMode() {
         windowLine = 0;
         STAT = (STAT & 0xFC) | 0x02; // Mode 2 (OAM Search)
         if (STAT & 0x20) interrupts->setLCDStatFlag(true);
-        findSprites(); // Search for sprites on line 0
+        startFrame(); // Decide if the new frame gets rendered
+        if (!skipFrame) {
+          findSprites(); // Search for sprites on line 0
+        }
         vBlank = false;
       }
       break;
@@ -234,7 +324,9 @@ void GPU::advanceMode() {
       
     case 3: // Pixel Transfer -> HBlank (Mode 0)
       STAT = (STAT & 0xFC) | 0x00;
-      renderScanline(); // Render the current scanline
+      if (!skipFrame) {
+        renderScanline(); // Render the current scanline
+      }
       if (STAT & 0x08) interrupts->setLCDStatFlag(true);
       if (HDMALength > 0 && HDMAActive) {
         doHDMATransfer();
@@ -243,6 +335,152 @@ void GPU::advanceMode() {
   }
 }
 
+void GPU::startFrame() {
+  // Automatic skipping takes priority over the fixed skip cycle
+  if (skipRequested) {
+    skipRequested = false;
+    skipFrame = true;
+  } else if (frameSkip > 0) {
+    skipFrame = frameSkipCounter != 0;
+    frameSkipCounter = (frameSkipCounter + 1) % (frameSkip + 1);
+  } else {
+    skipFrame = false;
+  }
+
+  // Start recording the frame if it is rendered deferred
+  deferredActive = deferredRequested && !skipFrame;
+  if (!deferredRequested && renderPool) {
+    delete renderPool; // Turned off, the last recorded frame is drawn
+    renderPool = nullptr;
+  }
+  lineLog.clear();
+  writeLog.clear();
+  if (deferredActive) {
+    memcpy(frameVRAM, VRAM, sizeof(VRAM));
+    memcpy(frameOAM, OAM, sizeof(OAM));
+  }
+}
+
+void GPU::setFrameSkip(int frames) {
+  frameSkip = frames < 0 ? 0 : frames;
+  frameSkipCounter = 0;
+}
+
+void GPU::skipNextFrame() { skipRequested = true; }
+
+void GPU::setLayerCache(bool enable) {
+  if (enable && !layerCache) {
+    layerCache = new LayerCache(CGB);
+  } else if (!enable) {
+    delete layerCache;
+    layerCache = nullptr;
+  }
+}
+
+void GPU::saveState(StateWriter &state) const {
+  state.beginSection("GPU ");
+  state.write(VRAM, sizeof(VRAM));
+  state.write(OAM, sizeof(OAM));
+  state.write(visiableSprites, sizeof(visiableSprites));
+  state.put(spriteCount);
+  state.put(cycleCount);
+  state.put(LCDC);
+  state.put(LY);
+  state.put(LYC);
+  state.put(STAT);
+  state.put(SCY);
+  state.put(SCX);
+  state.put(WY);
+  state.put(windowLine);
+  state.put(WX);
+  state.put(BGP);
+  state.put(OBP0);
+  state.put(OBP1);
+  state.put(BCPS);
+  state.put(OCPS);
+  state.put(VRAMBank);
+  state.write(bgPalettes, sizeof(bgPalettes));
+  state.write(objPalettes, sizeof(objPalettes));
+  state.put(HDMALength);
+  state.put(HDMASource);
+  state.put(HDMADest);
+  state.put(HDMAActive);
+  state.put(vBlank);
+  state.endSection();
+}
+
+void GPU::loadState(StateReader &state) {
+  // Draw the lines recorded so far with the VRAM they were captured with
+  if (deferredActive) {
+    renderDeferredFrame();
+  }
+
+  state.openSection("GPU ");
+  state.read(VRAM, sizeof(VRAM));
+  state.read(OAM, sizeof(OAM));
+  state.read(visiableSprites, sizeof(visiableSprites));
+  state.get(spriteCount);
+  state.get(cycleCount);
+  state.get(LCDC);
+  state.get(LY);
+  state.get(LYC);
+  state.get(STAT);
+  state.get(SCY);
+  state.get(SCX);
+  state.get(WY);
+  state.get(windowLine);
+  state.get(WX);
+  state.get(BGP);
+  state.get(OBP0);
+  state.get(OBP1);
+  state.get(BCPS);
+  state.get(OCPS);
+  state.get(VRAMBank);
+  state.read(bgPalettes, sizeof(bgPalettes));
+  state.read(objPalettes, sizeof(objPalettes));
+  state.get(HDMALength);
+  state.get(HDMASource);
+  state.get(HDMADest);
+  state.get(HDMAActive);
+  state.get(vBlank);
+
+  // Everything derived from VRAM and OAM is rebuilt
+  memset(bucketDirty, true, sizeof(bucketDirty));
+  bucketsDirty = true;
+  if (layerCache) {
+    layerCache->invalidate();
+  }
+  // The rest of the frame is recorded against the loaded VRAM
+  if (deferredActive) {
+    lineLog.clear();
+    writeLog.clear();
+    memcpy(frameVRAM, VRAM, sizeof(VRAM));
+    memcpy(frameOAM, OAM, sizeof(OAM));
+  }
+}
+
+void GPU::setDeferredRendering(bool enable, int threads) {
+  // Takes effect when the next frame starts. A frame being recorded is
+  // still drawn on the pool, startFrame frees it once it is off.
+  deferredRequested = enable;
+  if (!enable) {
+    return;
+  }
+  if (threads != deferredThreads) {
+    delete renderPool;
+    renderPool = nullptr;
+  }
+  deferredThreads = threads;
+  if (!renderPool) {
+    if (threads <= 0) {
+      threads = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    renderPool = new ThreadPool(threads - 1); // The GPU thread also draws
+    lineLog.reserve(154);
+    writeLog.reserve(0x2000);
+  }
+}
+
 void GPU::checkLYC() {
   if (LY == LYC) {
     STAT |= 0x04; // Set the Coincidence Flag
@@ -277,14 +515,14 @@ void GPU::updateCGBPalette(uint16_t (&palettes)[8][4], BYTE &index_reg,
   }
 }
 
-uint32_t GPU::cgbToARGB(uint16_t rgb555) {
+uint32_t GPU::cgbToARGB(uint16_t rgb555) const {
   uint8_t r = (rgb555 & 0x1F) << 3; // 5 bits → 8 bits
   uint8_t g = ((rgb555 >> 5) & 0x1F) << 3;
   uint8_t b = ((rgb555 >> 10) & 0x1F) << 3;
   return 0xFF000000 | (r << 16) | (g << 8) | b;
 }
 
-uint32_t GPU::getDMGColor(uint8_t color_idx, BYTE palette) {
+uint32_t GPU::getDMGColor(uint8_t color_idx, BYTE palette) const {
   // Extract color from palette (BGP, OBP0, OBP1)
   uint8_t shade = (palette >> (color_idx * 2)) & 0x03;
   switch (shade) { // Map to ARGB8888
@@ -301,81 +539,316 @@ uint32_t GPU::getDMGColor(uint8_t color_idx, BYTE palette) {
 }
 
 void GPU::findSprites() {
-  spriteCount = 0;                // Reset sprite count
-  bool largeSprite = LCDC & 0x04; // Check if large sprites are enabled
+  buildSpriteBuckets();
+  if (LY >= 144) {
+    spriteCount = 0;
+    return;
+  }
+  spriteCount = bucketCounts[LY];
+  memcpy(visiableSprites, spriteBuckets[LY], spriteCount);
+}
+
+void GPU::invalidateSpriteRows(BYTE spriteY) {
+  if (spriteY == 0 || spriteY - 16 >= 144) {
+    return; // Sprite is not on the screen
+  }
+  // Minus 16 since the sprite Y is offseted by 16, cover tall sprites
+  int topY = std::max(spriteY - 16, 0);
+  int bottomY = std::min((int)spriteY, 144);
+  for (int row = topY; row < bottomY; row++) {
+    bucketDirty[row] = true;
+  }
+  bucketsDirty = true;
+}
 
+void GPU::buildSpriteBuckets() {
+  uint8_t spriteHeight = (LCDC & 0x04) ? 16 : 8; // Determine sprite height
+  if (spriteHeight != bucketHeight) {
+    memset(bucketDirty, true, sizeof(bucketDirty));
+    bucketsDirty = true;
+    bucketHeight = spriteHeight;
+  }
+  if (!bucketsDirty) {
+    return;
+  }
+
+  for (int row = 0; row < 144; row++) {
+    if (bucketDirty[row]) {
+      bucketCounts[row] = 0;
+    }
+  }
   for (int i = 0; i < 40; i++) {
     uint8_t spriteY = OAM[i * 4]; // Y coordinate
     if (spriteY == 0 || spriteY - 16 >= 144) {
       continue; // Skip if the sprite is not on the screen or Y ≤ 8 for 8×8
                 // sprites
     }
-    uint8_t spriteHeight = largeSprite ? 16 : 8; // Determine sprite height
     // Adjust Y coordinate for sprite height
     // Minus 16 since the sprite Y is offseted by 16
     int topY = spriteY - 16;
     int bottomY = topY + spriteHeight; // Calculate bottom Y coordinate
-    // Check if the sprite is within the current line
-    if (LY >= topY && LY < bottomY) {
-      visiableSprites[spriteCount] = i; // Store the sprite index
-      spriteCount++;
-      if (spriteCount >= 10) {
-        break; // Limit to 10 sprites per line
+    for (int row = std::max(topY, 0); row < std::min(bottomY, 144); row++) {
+      // Limit to 10 sprites per line
+      if (bucketDirty[row] && bucketCounts[row] < 10) {
+        spriteBuckets[row][bucketCounts[row]++] = i; // Store the sprite index
+      }
+    }
+  }
+
+  for (int row = 0; row < 144; row++) {
+    if (!bucketDirty[row]) {
+      continue;
+    }
+    bucketDirty[row] = false;
+    // In CGB mode, priority is determined by OAM order, which is the order
+    // the sprites were found in
+    if (CGB) {
+      continue;
+    }
+    // In non-CGB mode, smaller X has higher priority; if equal, earlier OAM
+    // index wins. Insertion sort keeps equal X in OAM order.
+    BYTE *sprites = spriteBuckets[row];
+    for (int i = 1; i < bucketCounts[row]; i++) {
+      BYTE sprite = sprites[i];
+      int j = i - 1;
+      while (j >= 0 && OAM[sprites[j] * 4 + 1] > OAM[sprite * 4 + 1]) {
+        sprites[j + 1] = sprites[j];
+        j--;
       }
+      sprites[j + 1] = sprite;
     }
   }
+  bucketsDirty = false;
 }
 
-void GPU::renderFrame(SDL_Renderer *ren) {
+void GPU::renderFrame() {
   // Gameboy screen: 160x144
-  SDL_Surface *mainSurface = SDL_CreateRGBSurface(0, 160, 144, 32, 0, 0, 0, 0);
+  if (!videoSink) {
+    return;
+  }
+  if (!sinkConverter) {
+    videoSink->presentFrame(getFrameBuffer(), 160 * sizeof(uint32_t));
+    return;
+  }
+  int pitch = 160 * sinkConverter->getBytesPerPixel();
+  convertFrame(*sinkConverter, presentBuffer, pitch);
+  videoSink->presentFrame(presentBuffer, pitch);
+}
+
+void GPU::setVideoSink(VideoSink *sink) {
+  videoSink = sink;
+  delete sinkConverter;
+  sinkConverter = nullptr;
+  // XRGB8888 sinks share the cached frame buffer
+  if (sink && sink->getPixelFormat() != PIXEL_XRGB8888) {
+    sinkConverter = new PixelConverter(sink->getPixelFormat());
+  }
+}
 
-  // Copy background surface to the main surface
-  SDL_BlitSurface(backgroundGlobal, NULL, mainSurface, NULL);
+const uint32_t *GPU::getFrameBuffer() {
+  if (!frameConverted) {
+    convertFrame(*xrgbConverter, frameBuffer, 160 * sizeof(uint32_t));
+    frameConverted = true;
+  }
+  return frameBuffer;
+}
+
+void GPU::convertFrame(PixelConverter &converter, void *pixels,
+                       int pitch) const {
+  uint32_t colors[64];
+  for (int y = 0; y < 144; y++) {
+    // The color table only changes when a line's palettes differ from the
+    // line above it
+    const LinePalette &palette = linePalettes[y];
+    const LinePalette &above = linePalettes[y > 0 ? y - 1 : 0];
+    if (y == 0 || palette.BGP != above.BGP || palette.OBP0 != above.OBP0 ||
+        palette.OBP1 != above.OBP1 ||
+        (CGB && (memcmp(palette.bgPalettes, above.bgPalettes,
+                        sizeof(palette.bgPalettes)) != 0 ||
+                 memcmp(palette.objPalettes, above.objPalettes,
+                        sizeof(palette.objPalettes)) != 0))) {
+      getLineColors(palette, colors);
+      converter.setPalette(colors);
+    }
+    converter.convertLine(&indexBuffer[y * 160], 160,
+                          static_cast<BYTE *>(pixels) + y * pitch);
+  }
+}
 
-  // Render main surface
-  SDL_Texture *tex = SDL_CreateTextureFromSurface(ren, mainSurface);
-  SDL_FreeSurface(mainSurface);
-  SDL_RenderClear(ren);
-  SDL_RenderCopy(ren, tex, NULL, NULL);
-  SDL_RenderPresent(ren);
+uint64_t GPU::hashFrame() {
+  // Hash the presented colors rather than the palette indices so the hash
+  // only changes when the picture does
+  const uint32_t *pixels = getFrameBuffer();
+  uint64_t hash = 0x9E3779B97F4A7C15ull;
+  for (int i = 0; i < 160 * 144; i += 2) {
+    uint64_t value = ((uint64_t)(pixels[i + 1] & 0xFFFFFF) << 32) |
+                     (pixels[i] & 0xFFFFFF);
+    hash ^= value * 0xC2B2AE3D27D4EB4Full;
+    hash = ((hash << 31) | (hash >> 33)) * 0x9E3779B97F4A7C15ull;
+  }
+  // Final mix so every input bit affects every output bit
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  return hash;
+}
 
-  SDL_DestroyTexture(tex);
+void GPU::getLineColors(const LinePalette &palette, uint32_t *colors) const {
+  memset(colors, 0, 64 * sizeof(uint32_t));
+  if (CGB) {
+    for (int i = 0; i < 32; i++) {
+      colors[i] = cgbToARGB(palette.bgPalettes[i >> 2][i & 0x03]);
+      colors[32 + i] = cgbToARGB(palette.objPalettes[i >> 2][i & 0x03]);
+    }
+  } else {
+    for (int i = 0; i < 4; i++) {
+      colors[i] = getDMGColor(i, palette.BGP);
+      colors[32 + i] = getDMGColor(i, palette.OBP0);
+      colors[36 + i] = getDMGColor(i, palette.OBP1);
+    }
+  }
 }
 
 void GPU::renderScanline() {
-  // Check if the LCD is enabled
-  if (!(LCDC & 0x80)) {
-    memset(lineBuffer, 0xFF, sizeof(lineBuffer)); // Clear the line buffer
+  if (deferredActive) {
+    // Only record the line, it is drawn at VBlank
+    lineLog.emplace_back();
+    captureScanline(lineLog.back());
     return;
   }
+  ScanlineState line;
+  captureScanline(line);
+  drawScanline(line, VRAM, OAM);
+  frameConverted = false;
+}
+
+void GPU::captureScanline(ScanlineState &line) {
+  line.LY = LY;
+  line.LCDC = LCDC;
+  line.SCX = SCX;
+  line.SCY = SCY;
+  line.WX = WX;
+  line.WY = WY;
+  // The window line counter only advances on lines that show the window
+  line.windowVisible = (LCDC & 0x80) && (LCDC & 0x20) && (LCDC & 0x01) &&
+                       LY >= WY && WX - 7 < 160;
+  line.windowLine = windowLine;
+  if (line.windowVisible) {
+    windowLine++;
+  }
+  line.palette.BGP = BGP;
+  line.palette.OBP0 = OBP0;
+  line.palette.OBP1 = OBP1;
+  line.spriteCount = spriteCount;
+  memcpy(line.sprites, visiableSprites, sizeof(visiableSprites));
+  if (CGB) {
+    memcpy(line.palette.bgPalettes, bgPalettes, sizeof(bgPalettes));
+    memcpy(line.palette.objPalettes, objPalettes, sizeof(objPalettes));
+  }
+}
+
+void GPU::drawScanline(const ScanlineState &line, const BYTE *vram,
+                       const BYTE *oam) {
+  // Check if the LCD is enabled
+  if (!(line.LCDC & 0x80)) {
+    return; // Keep what was on the line before
+  }
+  LineBuffers buffers;
+  memset(buffers.pixels, 0x40, sizeof(buffers.pixels)); // Blank
+  // Without a background every pixel counts as color 0 for sprite priority
+  memset(buffers.bgPriorities, 0, sizeof(buffers.bgPriorities));
+  memset(buffers.bgColorIndices, 0, sizeof(buffers.bgColorIndices));
+  // Deferred frames are drawn from rebuilt copies of VRAM, those bypass the
+  // cache since it follows the live VRAM
+  bool cached = layerCache && vram == VRAM;
   // Render the background line
-  if (LCDC & 0x01) {
-    renderBG();
+  if (line.LCDC & 0x01) {
+    if (cached) {
+      renderCachedLayer(line, (line.LCDC & 0x08) ? 1 : 0, line.SCX,
+                        (line.SCY + line.LY) % 256, buffers);
+    } else {
+      renderBG(line, vram, buffers);
+    }
   }
   // Render the window line
-  if (LCDC & 0x20 && LCDC & 0x01) {
-    renderWindow();
+  if (line.LCDC & 0x20 && line.LCDC & 0x01) {
+    // A window left of the screen edge starts at a negative column, that
+    // case is left to the uncached renderer
+    if (cached && line.WX >= 7) {
+      if (line.windowVisible) {
+        renderCachedLayer(line, (line.LCDC & 0x40) ? 1 : 0, line.WX - 7,
+                          line.windowLine, buffers);
+      }
+    } else {
+      renderWindow(line, vram, buffers);
+    }
   }
   // Render sprites on the line
-  if (LCDC & 0x02) {
-    renderSprites();
+  if (line.LCDC & 0x02) {
+    renderSprites(line, vram, oam, buffers);
   }
 
-  // Declare BG pixels pointer/array
-  uint32_t *globalBGPixels = (uint32_t *)backgroundGlobal->pixels;
+  // Copy the line and its palettes into the frame
+  memcpy(&indexBuffer[line.LY * 160], buffers.pixels, sizeof(buffers.pixels));
+  linePalettes[line.LY] = line.palette;
+}
+
+void GPU::renderDeferredFrame() {
+  // Lines can be drawn in parallel if each row was captured once, in order.
+  // Writes to LY in the middle of a frame break that, so those frames are
+  // drawn on a single band.
+  int lineCount = lineLog.size();
+  bool ordered = lineCount == 144;
+  for (int i = 0; ordered && i < lineCount; i++) {
+    ordered = lineLog[i].LY == i;
+  }
+  int bands = ordered ? renderPool->getThreadCount() : 1;
+
+  renderPool->parallelFor(bands, [this, lineCount, bands](int band) {
+    int first = lineCount * band / bands;
+    int last = lineCount * (band + 1) / bands;
+    // Rebuild VRAM and OAM as they were when the first line was drawn
+    BYTE vram[0x4000];
+    BYTE oam[0xA0];
+    memcpy(vram, frameVRAM, sizeof(vram));
+    memcpy(oam, frameOAM, sizeof(oam));
+    size_t write = 0;
+    for (int i = first; i < last; i++) {
+      // Apply every write made before this line was captured
+      while (write < writeLog.size() && writeLog[write].line <= i) {
+        const VideoWrite &change = writeLog[write++];
+        if (change.offset >= 0x4000) {
+          oam[change.offset - 0x4000] = change.value;
+        } else {
+          vram[change.offset] = change.value;
+        }
+      }
+      const ScanlineState &line = lineLog[i];
+      drawScanline(line, vram, oam);
+    }
+  });
+  frameConverted = false;
+}
+
+void GPU::renderCachedLayer(const ScanlineState &line, int map, int x, int y,
+                            LineBuffers &buffers) {
+  const BYTE *row =
+      layerCache->getRow(VRAM, map, y, x, 160, (line.LCDC & 0x10) != 0);
 
   for (int i = 0; i < 160; i++) {
-    int pixelData = lineBuffer[i];
-    // Write the pixel data to the global background surface
-    globalBGPixels[i + (LY * backgroundGlobal->w)] = pixelData;
-    lineBuffer[i] = 0;
+    BYTE pixel = row[(x + i) & 0xFF]; // Wrap around X scroll
+    buffers.pixels[i] = pixel & 0x1F; // Palette number and color index
+    buffers.bgColorIndices[i] = pixel & 0x03;
+    if (CGB) {
+      buffers.bgPriorities[i] = pixel & 0x80; // True if the tile has priority
+    }
   }
 }
 
-void GPU::renderBG() {
-  int x = SCX;              // X scroll
-  int y = (SCY + LY) % 256; // Y scroll (wrap around)
+void GPU::renderBG(const ScanlineState &line, const BYTE *vram,
+                   LineBuffers &buffers) const {
+  int x = line.SCX;                   // X scroll
+  int y = (line.SCY + line.LY) % 256; // Y scroll (wrap around)
   for (int i = 0; i < 160; i++, x++) {
     if (x >= 256) {
       x = 0; // Wrap around X scroll
@@ -384,11 +857,11 @@ void GPU::renderBG() {
     // Each tile is 8x8 pixels, so we divide the coordinates by 8
     int tileIndex = ((y / 8) * 32) + (x / 8);
     uint16_t mapLocation =
-        ((LCDC & 0x08) ? 0x1C00 : 0x1800) + tileIndex; // Map location
-    uint16_t tileLocation = VRAM[mapLocation];         // Tile map content
-    uint8_t mapAtrribute = VRAM[0x2000 | mapLocation]; // Map attribute content
+        ((line.LCDC & 0x08) ? 0x1C00 : 0x1800) + tileIndex; // Map location
+    uint16_t tileLocation = vram[mapLocation];              // Tile map content
+    uint8_t mapAtrribute = vram[0x2000 | mapLocation]; // Map attribute content
     // 0x8000 method
-    if (LCDC & 0x10) {
+    if (line.LCDC & 0x10) {
       tileLocation <<= 4; // Shift since each tile is 16 bytes
     }
     // 0x8800 method
@@ -423,34 +896,34 @@ void GPU::renderBG() {
     // The pixel data is stored in two bytes, each byte contains 8 pixels
     // The first byte contains the lower bits and the second byte contains the
     // Fetch the lower byte of the pixel data for the current row
-    BYTE lowerByte = VRAM[tileLocation + (pixelY * 2)];
+    BYTE lowerByte = vram[tileLocation + (pixelY * 2)];
     // Fetch the upper byte of the pixel data for the current row
-    BYTE upperByte = VRAM[tileLocation + (pixelY * 2) + 1];
+    BYTE upperByte = vram[tileLocation + (pixelY * 2) + 1];
     // Extract the pixel data for the current column (pixelX)
     int pixelData = ((lowerByte >> (7 - pixelX)) & 0x01) |
                     (((upperByte >> (7 - pixelX)) & 0x01) << 1);
     // In Game Boy color background tiles have a priority bit
     if (CGB) {
-      bgPriorties[i] = (mapAtrribute & 0x80); // True if the tile has priority
-      lineBuffer[i] = cgbToARGB(bgPalettes[mapAtrribute & 0x07][pixelData]);
+      // True if the tile has priority
+      buffers.bgPriorities[i] = (mapAtrribute & 0x80);
+      buffers.pixels[i] = ((mapAtrribute & 0x07) << 2) | pixelData;
     } else {
-      lineBuffer[i] = getDMGColor(pixelData, BGP);
+      buffers.pixels[i] = pixelData; // DMG background uses BGP
     }
-    bgColorIndices[i] = pixelData; // Add this line
+    buffers.bgColorIndices[i] = pixelData; // Add this line
   }
 }
 
-void GPU::renderWindow() {
-  int x = WX - 7; // Window X position (subtract 7 for the window offset)
-  int y = WY;     // Window Y position
+void GPU::renderWindow(const ScanlineState &line, const BYTE *vram,
+                       LineBuffers &buffers) const {
+  int x = line.WX - 7; // Window X position (subtract 7 for the window offset)
 
   // Check if the window on the current line
-  if (LY < y || x >= 160) {
+  if (!line.windowVisible) {
     return; // Window is not visible
   }
 
-  y = windowLine;
-  windowLine++; // Increment window line
+  int y = line.windowLine; // Window line counter captured for this line
 
   for (int i = 0; i < 160; i++, x++) {
     if (x >= 256) {
@@ -458,11 +931,11 @@ void GPU::renderWindow() {
     }
     int tileIndex = ((y / 8) * 32) + (x / 8); // Calculate tile index
     uint16_t mapLocation =
-        ((LCDC & 0x40) ? 0x1C00 : 0x1800) + tileIndex; // Map location
-    uint16_t tileLocation = VRAM[mapLocation];         // Tile map content
-    uint8_t mapAtrribute = VRAM[0x2000 | mapLocation]; // Map attribute content
+        ((line.LCDC & 0x40) ? 0x1C00 : 0x1800) + tileIndex; // Map location
+    uint16_t tileLocation = vram[mapLocation];              // Tile map content
+    uint8_t mapAtrribute = vram[0x2000 | mapLocation]; // Map attribute content
     // 0x8000 method
-    if (LCDC & 0x10) {
+    if (line.LCDC & 0x10) {
       tileLocation <<= 4; // Shift since each tile is 16 bytes
     }
     // 0x8800 method
@@ -493,50 +966,38 @@ void GPU::renderWindow() {
     }
 
     // Get the pixel data
-    BYTE lowerByte = VRAM[tileLocation + (pixelY * 2)];
-    BYTE upperByte = VRAM[tileLocation + (pixelY * 2) + 1];
+    BYTE lowerByte = vram[tileLocation + (pixelY * 2)];
+    BYTE upperByte = vram[tileLocation + (pixelY * 2) + 1];
     int pixelData = ((lowerByte >> (7 - pixelX)) & 0x01) |
                     (((upperByte >> (7 - pixelX)) & 0x01) << 1);
     if (CGB) {
-      bgPriorties[i] = (mapAtrribute & 0x80); // True if the tile has priority
-      lineBuffer[i] = cgbToARGB(
-          bgPalettes[mapAtrribute & 0x07][pixelData]); // Apply the palette
+      // True if the tile has priority
+      buffers.bgPriorities[i] = (mapAtrribute & 0x80);
+      buffers.pixels[i] =
+          ((mapAtrribute & 0x07) << 2) | pixelData; // Apply the palette
     } else {
-      lineBuffer[i] = getDMGColor(pixelData, BGP);
+      buffers.pixels[i] = pixelData; // DMG background uses BGP
     }
-    bgColorIndices[i] = pixelData; // Add this line
+    buffers.bgColorIndices[i] = pixelData; // Add this line
   }
 }
 
-void GPU::renderSprites() {
+void GPU::renderSprites(const ScanlineState &line, const BYTE *vram,
+                        const BYTE *oam, LineBuffers &buffers) const {
   uint8_t spriteHeight =
-      (LCDC & 0x04) ? 16 : 8; // Check if large sprites are enabled
-
-  // Sort visible sprites based on priority
-  std::sort(visiableSprites, visiableSprites + spriteCount,
-            [this](int a, int b) {
-              uint8_t xA = OAM[a * 4 + 1]; // X coordinate of sprite A
-              uint8_t xB = OAM[b * 4 + 1]; // X coordinate of sprite B
-              if (CGB) {
-                // In CGB mode, priority is determined by OAM order
-                return a < b;
-              } else {
-                // In non-CGB mode, smaller X has higher priority; if equal,
-                // earlier OAM index wins
-                return (xA < xB) || (xA == xB && a < b);
-              }
-            });
-
-  // Render sprites
-  for (int i = 0; i < spriteCount; i++) {
-    uint8_t spriteIndex = visiableSprites[i];
-    uint8_t spriteY = OAM[spriteIndex * 4];        // Y coordinate
-    uint8_t spriteX = OAM[spriteIndex * 4 + 1];    // X coordinate
-    uint8_t tileIndex = OAM[spriteIndex * 4 + 2];  // Tile index
-    uint8_t attributes = OAM[spriteIndex * 4 + 3]; // Attributes
-
-    uint8_t pixelY = (attributes & 0x40) ? (spriteHeight - 1) - (LY - spriteY)
-                                         : LY - spriteY; // Flip Y if needed
+      (line.LCDC & 0x04) ? 16 : 8; // Check if large sprites are enabled
+
+  // Render sprites, the line's sprites are already in priority order
+  for (int i = 0; i < line.spriteCount; i++) {
+    uint8_t spriteIndex = line.sprites[i];
+    uint8_t spriteY = oam[spriteIndex * 4];        // Y coordinate
+    uint8_t spriteX = oam[spriteIndex * 4 + 1];    // X coordinate
+    uint8_t tileIndex = oam[spriteIndex * 4 + 2];  // Tile index
+    uint8_t attributes = oam[spriteIndex * 4 + 3]; // Attributes
+
+    uint8_t pixelY = (attributes & 0x40)
+                         ? (spriteHeight - 1) - (line.LY - spriteY)
+                         : line.LY - spriteY; // Flip Y if needed
 
     // Re-adjust the tile index for tall sprites
     if (spriteHeight == 16) {
@@ -557,8 +1018,8 @@ void GPU::renderSprites() {
       tilePointer |= 0x2000;
     }
 
-    int lowerByte = VRAM[tilePointer + (2 * (pixelY % 8))];
-    int upperByte = VRAM[tilePointer + (2 * (pixelY % 8)) + 1];
+    int lowerByte = vram[tilePointer + (2 * (pixelY % 8))];
+    int upperByte = vram[tilePointer + (2 * (pixelY % 8)) + 1];
 
     // Render the sprite pixels
     for (int x = 0; x < 8; x++) {
@@ -579,8 +1040,8 @@ void GPU::renderSprites() {
       // Handle priority and overwrite conditions
       // Priority handling
       if (CGB) {
-        bool bgPriority = bgPriorties[screenX];
-        uint8_t bgColor = bgColorIndices[screenX];
+        bool bgPriority = buffers.bgPriorities[screenX];
+        uint8_t bgColor = buffers.bgColorIndices[screenX];
         if (attributes & 0x80) { // Sprite behind BG
           if (bgColor != 0)
             continue;
@@ -589,18 +1050,19 @@ void GPU::renderSprites() {
             continue;
         }
       } else { // Non-CGB
-        if ((attributes & 0x80) && (bgColorIndices[screenX] != 0)) {
+        if ((attributes & 0x80) && (buffers.bgColorIndices[screenX] != 0)) {
           continue;
         }
       }
 
       // Apply the palette
       if (CGB) {
-        lineBuffer[screenX] =
-            cgbToARGB(objPalettes[attributes & 0x07][pixelData]);
+        buffers.pixels[screenX] =
+            0x20 | ((attributes & 0x07) << 2) | pixelData;
       } else {
-        lineBuffer[screenX] =
-            getDMGColor(pixelData, (attributes & 0x10) ? OBP1 : OBP0);
+        // OBP1 is sprite palette 1
+        buffers.pixels[screenX] =
+            0x20 | ((attributes & 0x10) ? 0x04 : 0x00) | pixelData;
       }
     }
   }
@@ -1,17 +1,60 @@
 #ifndef GPU_H
 #define GPU_H
+#include "Frontend.h"
 #include "Interrupts.h"
-#include "SDL2/SDL.h"
 #include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
 // Forward declaration
 class Memory;
+class ThreadPool;
+class LayerCache;
+class StateWriter;
+class StateReader;
+class PixelConverter;
+
+// Palettes in effect for a line, kept with the frame so palette indices can
+// be turned into colors when the frame is presented
+struct LinePalette {
+  BYTE BGP, OBP0, OBP1;       // DMG palettes
+  uint16_t bgPalettes[8][4];  // CGB palettes (RGB555)
+  uint16_t objPalettes[8][4];
+};
+
+// Everything the scanline renderer reads apart from VRAM and OAM, captured
+// at the moment a line is drawn (end of mode 3)
+struct ScanlineState {
+  BYTE LY;
+  BYTE LCDC;
+  BYTE SCX, SCY;
+  BYTE WX, WY;
+  bool windowVisible; // Window is drawn on this line
+  int windowLine;     // Window line counter used by this line
+  BYTE sprites[10];   // Sprites found during the OAM search
+  BYTE spriteCount;
+  LinePalette palette; // Palettes in effect for the line
+};
+
+// Working buffers for drawing a single line
+struct LineBuffers {
+  BYTE pixels[160];             // Palette indices of the line being rendered
+  bool bgPriorities[160];       // Background priorities for each pixel
+  uint8_t bgColorIndices[160];  // BG color indices (0-3)
+};
+
+// A VRAM or OAM write made while a deferred frame is being recorded
+struct VideoWrite {
+  WORD offset; // VRAM offset, or OAM offset + 0x4000
+  WORD line;   // Number of lines captured before the write, LY writes can
+               // make a frame capture more than 256
+  BYTE value;
+};
 
 class GPU {
 private:
@@ -30,8 +73,15 @@ private:
   BYTE visiableSprites[10]; // Array to hold visible sprites
   BYTE spriteCount;         // Number of sprites on the current line
 
+  // Sprites on each visible line, already in drawing order. Rows are only
+  // rebuilt when an OAM write moves a sprite onto or off them.
+  BYTE spriteBuckets[144][10]; // Sprite indices for each line
+  BYTE bucketCounts[144];      // Number of sprites on each line
+  bool bucketDirty[144];       // Line needs to be rebuilt
+  bool bucketsDirty;           // Any line needs to be rebuilt
+  int bucketHeight;            // Sprite height the buckets were built with
+
   int cycleCount;           // Cycle count for the GPUF
-  uint32_t lineBuffer[160]; // Line buffer for the current line being rendered
 
   BYTE LCDC; // LCD Control
   BYTE LY;   // LCD Y Coordinate
@@ -57,9 +107,43 @@ private:
 
   uint16_t bgPalettes[8][4];     // 8 BG palettes, 4 colors each (RGB555)
   uint16_t objPalettes[8][4];    // 8 OBJ palettes, 4 colors each (RGB555)
-  bool bgPriorties[160];         // Background priorities for each pixel
-  uint8_t bgColorIndices[160];   // New buffer for BG color indices (0-3)
-  SDL_Surface *backgroundGlobal; // Global background surface
+  // The frame is kept as palette indices:
+  //   bits 0-1  color index (0-3)
+  //   bits 2-4  palette number (CGB 0-7, DMG OBP0 = 0 and OBP1 = 1)
+  //   bit 5     sprite palette
+  //   bit 6     blank (background disabled), presented as 0
+  BYTE indexBuffer[160 * 144];      // Palette indices of the frame
+  LinePalette linePalettes[144];    // Palettes each line was drawn with
+  uint32_t frameBuffer[160 * 144];  // Frame converted to XRGB8888
+  bool frameConverted;              // frameBuffer matches indexBuffer
+  uint32_t presentBuffer[160 * 144]; // Frame in the video sink's format
+  PixelConverter *xrgbConverter;    // Converts to XRGB8888
+  PixelConverter *sinkConverter;    // Converts to the video sink's format
+  VideoSink *videoSink;             // Where completed frames are presented
+
+  // Frame skipping, timing is kept exact but no pixels are produced
+  int frameSkip;          // Frames skipped between rendered frames (0 = none)
+  int frameSkipCounter;   // Position within the current skip cycle
+  bool skipFrame;         // True if the current frame is not being rendered
+  bool skipRequested;     // Skip the next frame (used for automatic skipping)
+  uint64_t framesRendered; // Number of frames that were rendered
+  uint64_t framesSkipped;  // Number of frames that were skipped
+
+  bool frameHashing;  // Hash every rendered frame
+  uint64_t frameHash; // Hash of the last rendered frame
+
+  // Deferred rendering, lines are captured during the frame and drawn in
+  // parallel once VBlank starts
+  bool deferredRequested;          // Deferred rendering turned on
+  bool deferredActive;             // Current frame is being recorded
+  int deferredThreads;             // Worker threads to use (0 = automatic)
+  ThreadPool *renderPool;          // Workers that draw the recorded lines
+  BYTE frameVRAM[0x4000];          // VRAM when the recorded frame started
+  BYTE frameOAM[0xA0];             // OAM when the recorded frame started
+  std::vector<ScanlineState> lineLog; // Lines captured this frame
+  std::vector<VideoWrite> writeLog;   // VRAM/OAM writes made this frame
+
+  LayerCache *layerCache; // Pre-rendered BG/window layers, null if disabled
 
   // HDMA length for VRAM transfer
   BYTE HDMALength; // Length of the transfer
@@ -70,17 +154,38 @@ private:
   // Helper functions
   void checkLYC();       // Check the LY Compare register
   void findSprites();    // Find sprites for the current line
+  void buildSpriteBuckets();            // Rebuild the dirty sprite lines
+  void invalidateSpriteRows(BYTE spriteY); // Lines a sprite at Y can cover
   void renderScanline(); // Render the current scanline
-  void renderBG();       // Render the background for the current line
-  void renderWindow();   // Render the window for the current line
-  void renderSprites();  // Render the sprites for the current line
+  void captureScanline(ScanlineState &line); // Capture the rendering inputs
+  // Draw a captured line into the index buffer using the given VRAM and
+  // OAM, the layer cache is only used when vram is the live VRAM
+  void drawScanline(const ScanlineState &line, const BYTE *vram,
+                    const BYTE *oam);
+  // Render the background for a line
+  void renderBG(const ScanlineState &line, const BYTE *vram,
+                LineBuffers &buffers) const;
+  // Render the window for a line
+  void renderWindow(const ScanlineState &line, const BYTE *vram,
+                    LineBuffers &buffers) const;
+  // Copy a line of a cached layer, used for both the background and window
+  void renderCachedLayer(const ScanlineState &line, int map, int x, int y,
+                         LineBuffers &buffers);
+  // Render the sprites for a line
+  void renderSprites(const ScanlineState &line, const BYTE *vram,
+                     const BYTE *oam, LineBuffers &buffers) const;
+  void renderDeferredFrame(); // Draw the recorded frame
+  uint64_t hashFrame();       // 64-bit hash of the frame's colors
   void updateCGBPalette(uint16_t (&palettes)[8][4], BYTE &index_reg, BYTE data);
-  uint32_t getDMGColor(uint8_t color_idx, BYTE palette);
-  uint32_t cgbToARGB(uint16_t rgb555); // Convert RGB555 to ARGB8888
+  uint32_t getDMGColor(uint8_t color_idx, BYTE palette) const;
+  uint32_t cgbToARGB(uint16_t rgb555) const; // Convert RGB555 to ARGB8888
+  // Fill the 64 entry color table for a line's palettes
+  void getLineColors(const LinePalette &palette, uint32_t *colors) const;
   void doHDMATransfer();
 
   int getModeDuration();
   void advanceMode();
+  void startFrame(); // Called when LY wraps to 0, handles frame skipping
 
 public:
   GPU(Interrupts *interrupts, bool CGB = false,
@@ -89,10 +194,36 @@ public:
   void writeData(WORD address, BYTE value); // Write data to the GPU registers
   BYTE readData(WORD address) const;        // Read data from the GPU registers
   void updateGPU(int cycles);               // Update the GPU timers
-  void renderFrame(SDL_Renderer *ren);      // Render the frame
+  void renderFrame();                       // Present the frame to the sink
+  void setVideoSink(VideoSink *sink);       // Set where frames are presented
+  // Frame as XRGB8888, converted from the indices when first asked for
+  const uint32_t *getFrameBuffer();
+  const BYTE *getIndexBuffer() const { return indexBuffer; }
+  const LinePalette *getLinePalettes() const { return linePalettes; }
+  // Convert the frame into any pixel format, pitch is in bytes
+  void convertFrame(PixelConverter &converter, void *pixels, int pitch) const;
   void setHDMA(BYTE len, WORD source, WORD dest,
                bool active);                        // Set the HDMA
   BYTE getHDMALength() const { return HDMALength; } // Get the HDMA length
+  void setFrameSkip(int frames);   // Render one frame out of every frames + 1
+  void skipNextFrame();            // Skip rendering of the next frame
+  bool frameSkipped() const { return skipFrame; } // Current frame skipped
+  uint64_t getFramesRendered() const { return framesRendered; }
+  uint64_t getFramesSkipped() const { return framesSkipped; }
+  // Record lines during the frame and draw them on threads at VBlank
+  // threads = 0 picks the number of threads from the hardware
+  void setDeferredRendering(bool enable, int threads = 0);
+  // Hash every rendered frame when it completes (at VBlank)
+  void setFrameHashing(bool enable) { frameHashing = enable; }
+  uint64_t getFrameHash() const { return frameHash; }
+  // Keep pre-rendered background/window layers (on by default)
+  void setLayerCache(bool enable);
+
+  // Save states. The frame being drawn is output rather than state, lines
+  // drawn before a load keep what they showed.
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+
   bool vBlank;    // Flag to indicate if the screen is blank
   Memory *memory; // Memory object to access memory
 };
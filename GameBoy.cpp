@@ -0,0 +1,94 @@
+#include "GameBoy.h"
+#include <fstream>
+
+// Audio block handed over at a time, about 3 ms at 44100 Hz so getAudio is
+// never far behind the emulation
+const int audioBlockSize = 256;
+
+GameBoy::GameBoy(const std::string &romPath)
+    : memory(nullptr), cpu(nullptr), state(nullptr), sampleRate(44100),
+      frameCount(0), cycleCredit(0) {
+  std::ifstream file(romPath, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return;
+  }
+  std::streamoff romSize = file.tellg();
+  if (romSize <= 0) {
+    return;
+  }
+  std::vector<BYTE> romData(romSize);
+  file.seekg(0, std::ios::beg);
+  file.read((char *)romData.data(), romData.size());
+  if (file.good()) {
+    powerOn(romData.data(), romData.size());
+  }
+}
+
+GameBoy::GameBoy(const BYTE *romData, size_t romSize)
+    : memory(nullptr), cpu(nullptr), state(nullptr), sampleRate(44100),
+      frameCount(0), cycleCredit(0) {
+  powerOn(romData, romSize);
+}
+
+GameBoy::~GameBoy() {
+  delete state;
+  delete cpu;
+  delete memory;
+}
+
+void GameBoy::powerOn(const BYTE *romData, size_t romSize) {
+  if (romSize < 0x8000) {
+    return; // Not even one full ROM bank, the header may be missing
+  }
+  memory = new Memory(romData, romSize);
+  if (!memory->hasCartridge()) {
+    delete memory;
+    memory = nullptr;
+    return;
+  }
+  cpu = new CPU(*memory);
+  state = new SaveState(*cpu, *memory);
+  if (!memory->CBG) {
+    cpu->resetGBNoBios();
+  } else {
+    cpu->resetCGBNoBios();
+  }
+  memory->setRealTimeClock(false);
+  memory->setInputSource(&buttons);
+  memory->setAudioFormat(sampleRate, audioBlockSize);
+  memory->setAudioSink(&audio);
+}
+
+int GameBoy::step() {
+  int cycles = cpu->step();
+  if (memory->gpu->vBlank) {
+    memory->gpu->vBlank = false;
+    frameCount++;
+  }
+  return cycles;
+}
+
+void GameBoy::runFrame() {
+  cpu->runFrame();
+  frameCount++;
+}
+
+void GameBoy::runCycles(int cycles) {
+  cycleCredit += cycles;
+  while (cycleCredit > 0) {
+    cycleCredit -= step();
+  }
+}
+
+void GameBoy::setVideoEnabled(bool enable) {
+  memory->gpu->setFrameSkip(enable ? 0 : 1 << 30); // Never draw when off
+}
+
+void GameBoy::setSampleRate(int rate) {
+  sampleRate = rate;
+  memory->setAudioFormat(sampleRate, audioBlockSize);
+}
+
+void GameBoy::setAudioEnabled(bool enable) {
+  memory->setAudioSink(enable ? &audio : nullptr);
+}
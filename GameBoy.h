@@ -0,0 +1,85 @@
+#ifndef GAMEBOY_H
+#define GAMEBOY_H
+#include "CPU.h"
+#include "Frontend.h"
+#include "Memory.h"
+#include "SaveState.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A whole Game Boy behind one object, the way other programs use
+// libgameboy. An instance owns everything it runs on: nothing is static or
+// global, it starts no threads and opens no devices, so any number of
+// instances can share a process. Each one must only be used by one thread at
+// a time, different instances can run on different threads. The only output
+// is the CPU's report of an illegal opcode, which a working game never hits.
+// Games are loaded without their save file, states take its place, and the
+// cartridge clock (MBC3) stands still unless setRealTimeClock turns it on,
+// so the same buttons always give the same frames and samples.
+class GameBoy {
+private:
+  // Keeps the audio blocks until they are cleared
+  class AudioBuffer : public AudioSink {
+  public:
+    std::vector<float> samples;
+    void queueSamples(const float *block, int count) override {
+      samples.insert(samples.end(), block, block + count);
+    }
+  };
+
+  Memory *memory;        // nullptr if the ROM could not be used
+  CPU *cpu;
+  SaveState *state;
+  HeldButtons buttons; // Set with setButtons
+  AudioBuffer audio;
+  int sampleRate;
+  uint64_t frameCount;   // VBlanks reached since power on
+  long long cycleCredit; // Owed to runCycles, below 0 after running past
+
+  void powerOn(const BYTE *romData, size_t romSize);
+  int step(); // One instruction, returns the cycles it took
+
+public:
+  GameBoy(const std::string &romPath);
+  GameBoy(const BYTE *romData, size_t romSize); // The ROM is copied
+  ~GameBoy();
+
+  // False if the ROM could not be read or its cartridge is not supported,
+  // nothing else may be called then
+  bool isValid() const { return memory != nullptr; }
+  bool isCGB() const { return memory->CBG; }
+
+  // Run until the next VBlank, the frame is then complete
+  void runFrame();
+  // Run for cycles of the 4.194304 MHz clock (also in double speed). The
+  // last instruction may run past the end, the next call is that much
+  // shorter so calls add up exactly.
+  void runCycles(int cycles);
+  uint64_t getFrameCount() const { return frameCount; }
+
+  // Bitmask of Button values (Frontend.h), held until changed
+  void setButtons(BYTE held) { buttons.buttons = held; }
+
+  // The last completed frame, 160x144 XRGB8888
+  const uint32_t *getFrame() { return memory->gpu->getFrameBuffer(); }
+  // Off skips drawing altogether, for runs nobody watches
+  void setVideoEnabled(bool enable);
+
+  // Interleaved stereo floats produced since the last clearAudio
+  const std::vector<float> &getAudio() const { return audio.samples; }
+  void clearAudio() { audio.samples.clear(); }
+  void setSampleRate(int rate); // 44100 Hz by default
+  int getSampleRate() const { return sampleRate; }
+  // Off drops the samples, the APU keeps running
+  void setAudioEnabled(bool enable);
+
+  // On lets the cartridge clock follow the system time
+  void setRealTimeClock(bool enable) { memory->setRealTimeClock(enable); }
+
+  // See SaveState.h, a state that does not load leaves the machine as it was
+  void saveState(std::vector<BYTE> &data) const { state->save(data); }
+  bool loadState(const std::vector<BYTE> &data) { return state->load(data); }
+};
+
+#endif
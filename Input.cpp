@@ -1,6 +1,8 @@
 #include "Input.h"
+#include "StateIO.h"
 
-Input::Input(Interrupts *interrupts) : interrupts(interrupts) {
+Input::Input(Interrupts *interrupts)
+    : interrupts(interrupts), source(nullptr) {
   joypad = 0xFF; // Initialize joypad state to all buttons released
 }
 
@@ -10,37 +12,22 @@ Input::~Input() {
 
 void Input::updateJoypadState(BYTE data) { joypad = data; }
 
+void Input::setInputSource(InputSource *source) { this->source = source; }
+
 BYTE Input::readJoypadState() {
-  const BYTE *keys = SDL_GetKeyboardState(NULL);
+  // Button bits are laid out so the low nibble is the d pad and the high
+  // nibble is the buttons, the joypad register uses 0 for pressed
+  BYTE pressed = source ? source->getButtons() : 0;
   BYTE state = 0;
   bool dpad = (joypad & 0x30) == 0x20; // Check if d pad mode is selected
   bool buttons = (joypad & 0x30) == 0x10; // Check if buttons mode is selected
   // Check if the d pad mode is selected, 0 means it is selected
   if (dpad) {
-    // Up
-    state |= (keys[SDL_SCANCODE_UP] ? 0 : 0x01) << 2;
-    // Down
-    state |= (keys[SDL_SCANCODE_DOWN] ? 0 : 0x01) << 3;
-    // Left
-    state |= (keys[SDL_SCANCODE_LEFT] ? 0 : 0x01) << 1;
-    // Right
-    state |= (keys[SDL_SCANCODE_RIGHT] ? 0 : 0x01);
+    // Right, Left, Up, Down
+    state = ~pressed & 0x0F;
   } else if (buttons) {
-    // These are the mappings for the buttons I chose to use
-    // Game Boy     Comupter
-    // A            Z
-    // B            X
-    // Select       Enter
-    // Start        Space
-
-    // A
-    state |= (keys[SDL_SCANCODE_Z] ? 0 : 0x01);
-    // B
-    state |= (keys[SDL_SCANCODE_X] ? 0 : 0x01) << 1;
-    // Select
-    state |= (keys[SDL_SCANCODE_RETURN] ? 0 : 0x01) << 2;
-    // Start
-    state |= (keys[SDL_SCANCODE_SPACE] ? 0 : 0x01) << 3;
+    // A, B, Select, Start
+    state = (~pressed >> 4) & 0x0F;
   }
 
   // Check if buttons are pressed to set the interrupt flag
@@ -56,4 +43,16 @@ BYTE Input::readJoypadState() {
   joypad &= 0xF0;       // Clear the lower nibble
   joypad |= state;      // Set the new state
   return joypad | 0xC0; // Return the state with the upper nibble set to 1
-}
\ No newline at end of file
+}
+
+// Save states, only the select bits, the buttons come from the source
+void Input::saveState(StateWriter &state) const {
+  state.beginSection("JOYP");
+  state.put(joypad);
+  state.endSection();
+}
+
+void Input::loadState(StateReader &state) {
+  state.openSection("JOYP");
+  state.get(joypad);
+}
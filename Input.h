@@ -1,22 +1,31 @@
 #ifndef INPUT_H
 #define INPUT_H
+#include "Frontend.h"
 #include "Interrupts.h"
-#include <SDL2/SDL.h>
 #include <cstdint>
 
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class Input {
 private:
   BYTE joypad;            // Joypad state
   Interrupts *interrupts; // Interrupts object
+  InputSource *source;    // Where the button state comes from
 
 public:
   Input(Interrupts *interrupts);     // Constructor
   ~Input();                          // Destructor
   void updateJoypadState(BYTE data); // Update joypad state
   BYTE readJoypadState();            // Read joypad state
+  void setInputSource(InputSource *source); // Set the button source
+
+  // Save states
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 };
 
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Interrupts.h"
+#include "StateIO.h"
 
 Interrupts::Interrupts() : IE(0), IF(0), IME(false) {
   // Constructor implementation
@@ -60,3 +61,19 @@ BYTE Interrupts::readLCDStatFlag() const { return IF & 0x02; } // LCD STAT
 BYTE Interrupts::readTimerFlag() const { return IF & 0x04; }   // Timer
 BYTE Interrupts::readSerialFlag() const { return IF & 0x08; }  // Serial
 BYTE Interrupts::readJoypadFlag() const { return IF & 0x10; }  // Joypad
+
+// Save states
+void Interrupts::saveState(StateWriter &state) const {
+  state.beginSection("INT ");
+  state.put(IE);
+  state.put(IF);
+  state.put(IME);
+  state.endSection();
+}
+
+void Interrupts::loadState(StateReader &state) {
+  state.openSection("INT ");
+  state.get(IE);
+  state.get(IF);
+  state.get(IME);
+}
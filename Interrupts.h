@@ -5,6 +5,9 @@
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class Interrupts {
 private:
   // IF & IE bit breakdown
@@ -27,6 +30,10 @@ public:
   bool getIME() const;      // Get the IME flag
   void handleInterrupts();  // Handle interrupts
 
+  // Save states
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+
   // Write to specific interrupt flags
   void setVBlankFlag(bool value);  // V-Blank
   void setLCDStatFlag(bool value); // LCD STAT
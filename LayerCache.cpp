@@ -0,0 +1,73 @@
+#include "LayerCache.h"
+#include <cstring>
+
+LayerCache::LayerCache(bool CGB) : CGB(CGB) {
+  memset(layers, 0, sizeof(layers));
+  memset(cellGens, 0, sizeof(cellGens));
+  memset(tileGens, 0, sizeof(tileGens));
+  invalidate();
+}
+
+void LayerCache::tileWritten(WORD offset) {
+  // Only tile data (0x8000-0x97FF in either bank) is tracked here, map
+  // entries are checked against the cell keys when they are used
+  WORD bankOffset = offset & 0x1FFF;
+  if (bankOffset < 0x1800) {
+    tileGens[(bankOffset >> 4) + ((offset & 0x2000) ? 384 : 0)]++;
+  }
+}
+
+void LayerCache::invalidate() {
+  // A key of 0 never matches since valid keys have bit 24 set
+  memset(cellKeys, 0, sizeof(cellKeys));
+}
+
+const BYTE *LayerCache::getRow(const BYTE *vram, int map, int y, int x,
+                               int width, bool unsignedTiles) {
+  WORD mapBase = map ? 0x1C00 : 0x1800;
+  int rowCell = (y / 8) * 32;
+  int firstColumn = x / 8;
+  int lastColumn = (x + width - 1) / 8;
+  for (int column = firstColumn; column <= lastColumn; column++) {
+    int cell = rowCell + (column & 31);
+    BYTE tileNumber = vram[mapBase + cell];
+    BYTE attribute = CGB ? vram[0x2000 | (mapBase + cell)] : 0;
+
+    // Tile slot in the generation table
+    int slot = unsignedTiles ? tileNumber : 256 + (int8_t)tileNumber;
+    if (attribute & 0x08) {
+      slot += 384; // Tile data from VRAM bank 1
+    }
+    uint32_t key = tileNumber | (attribute << 8) | (unsignedTiles << 16) |
+                   (1 << 24);
+    if (cellKeys[map][cell] != key || cellGens[map][cell] != tileGens[slot]) {
+      buildCell(vram, map, cell, key, slot);
+    }
+  }
+  return &layers[map][y * 256];
+}
+
+void LayerCache::buildCell(const BYTE *vram, int map, int cell, uint32_t key,
+                           int slot) {
+  BYTE attribute = (key >> 8) & 0xFF;
+  WORD tileLocation = (slot % 384) << 4; // Each tile is 16 bytes
+  if (attribute & 0x08) {
+    tileLocation |= 0x2000; // Fetch from VRAM bank 1
+  }
+  BYTE upperBits = ((attribute & 0x07) << 2) | (attribute & 0x80);
+
+  BYTE *out = &layers[map][(cell / 32) * 8 * 256 + (cell % 32) * 8];
+  for (int row = 0; row < 8; row++, out += 256) {
+    int pixelY = (attribute & 0x40) ? 7 - row : row; // Flip Y
+    BYTE lowerByte = vram[tileLocation + (pixelY * 2)];
+    BYTE upperByte = vram[tileLocation + (pixelY * 2) + 1];
+    for (int column = 0; column < 8; column++) {
+      int pixelX = (attribute & 0x20) ? 7 - column : column; // Flip X
+      int pixelData = ((lowerByte >> (7 - pixelX)) & 0x01) |
+                      (((upperByte >> (7 - pixelX)) & 0x01) << 1);
+      out[column] = upperBits | pixelData;
+    }
+  }
+  cellKeys[map][cell] = key;
+  cellGens[map][cell] = tileGens[slot];
+}
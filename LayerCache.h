@@ -0,0 +1,38 @@
+#ifndef LAYERCACHE_H
+#define LAYERCACHE_H
+#include <cstdint>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+
+// Pre-rendered 256x256 layers for both background tile maps (0x9800 and
+// 0x9C00). Each pixel is stored as a palette index:
+//   bits 0-1  color index (0-3)
+//   bits 2-4  CGB palette number
+//   bit 7     CGB BG-to-OAM priority
+// Cells (one tile of the map) are rebuilt only when the tile number, CGB
+// attributes, tile data or LCDC addressing mode they were drawn with change.
+class LayerCache {
+private:
+  BYTE layers[2][256 * 256];   // Palette index layers for both maps
+  uint32_t cellKeys[2][1024];  // Tile number, attributes and mode per cell
+  uint32_t cellGens[2][1024];  // Tile data generation per cell
+  uint32_t tileGens[768];      // Write generation of each tile (both banks)
+  bool CGB;                    // Use bank 1 and the map attributes
+
+  // Redraw one 8x8 cell of a layer
+  void buildCell(const BYTE *vram, int map, int cell, uint32_t key, int slot);
+
+public:
+  LayerCache(bool CGB);
+
+  void tileWritten(WORD offset); // Called for every write to VRAM
+  void invalidate();             // Redraw everything on next use
+
+  // Bring the cells covering width pixels of row y (starting at x and
+  // wrapping) up to date, then return the 256 pixel row of the layer
+  const BYTE *getRow(const BYTE *vram, int map, int y, int x, int width,
+                     bool unsignedTiles);
+};
+
+#endif
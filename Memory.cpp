@@ -4,28 +4,57 @@
 #include "Cartridges/MBC3.h"
 #include "Cartridges/MBC5.h"
 #include "Cartridges/NoMBC.h"
+#include "StateIO.h"
 #include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 
-Memory::Memory(const std::string filename) {
-  loadCartridge(filename);
+Memory::Memory(const std::string filename, bool battery) {
+  loadCartridge(filename, battery);
+  init();
+}
+
+Memory::Memory(const BYTE *romData, unsigned int romSize) {
+  // Quiet: the header is described to a stream with nowhere to write
+  std::ostream quiet(nullptr);
+  BYTE *romCopy = (BYTE *)malloc(romSize); // Freed by the cartridge
+  memcpy(romCopy, romData, romSize);
+  loadCartridge(romCopy, romSize, "", quiet);
+  init();
+}
+
+Memory::Memory(Cartridge *cartridge, bool CBG)
+    : cartridge(cartridge), romImage(nullptr), romImageSize(0), CBG(CBG) {
+  init();
+}
+
+Memory::Memory(Cartridge *cartridge, Interrupts *interrupts, Timers *timers,
+               GPU *gpu, Input *input, APU *apu, WRAM *wram, bool CBG)
+    : cartridge(cartridge), romImage(nullptr), romImageSize(0),
+      interrupts(interrupts), timers(timers), gpu(gpu), input(input), apu(apu),
+      wram(wram), CBG(CBG) {
+  resetRegisters();
+}
+
+// Create the components on the bus, the cartridge and CBG are set first
+void Memory::init() {
   interrupts = new Interrupts();
   gpu = new GPU(interrupts, CBG, this);
   wram = new WRAM();
   apu = new APU();
   timers = new Timers(interrupts);
   input = new Input(interrupts);
-  memset(highRAM, 0, sizeof(highRAM));
-  bootROM = false;
+  resetRegisters();
 }
 
-Memory::Memory(Cartridge *cartridge, Interrupts *interrupts, Timers *timers,
-               GPU *gpu, Input *input, APU *apu, WRAM *wram, bool CBG)
-    : cartridge(cartridge), interrupts(interrupts), timers(timers), gpu(gpu),
-      input(input), apu(apu), wram(wram), CBG(CBG) {
+// Power on values of the registers kept here
+void Memory::resetRegisters() {
   memset(highRAM, 0, sizeof(highRAM));
   bootROM = false;
+  key1 = 0;
+  OAMDMA = 0;
+  HDMA1 = HDMA2 = HDMA3 = HDMA4 = HDMA5 = 0;
 }
 
 Memory::~Memory() {
@@ -326,18 +355,32 @@ void Memory::VRAMDMATransfer() {
   }
 }
 
-void Memory::loadCartridge(const std::string filename) {
+void Memory::loadCartridge(const std::string filename, bool battery) {
   std::ifstream romFile(filename, std::ios::binary | std::ios::ate);
   if (!romFile.is_open()) {
     std::cerr << "Error opening ROM file." << std::endl;
     exit(1);
   }
   unsigned int romSize = romFile.tellg();
-  BYTE *romData = new BYTE[romSize];
+  BYTE *romData = (BYTE *)malloc(romSize); // Freed by the cartridge
   romFile.seekg(0);
   romFile.read(reinterpret_cast<char *>(romData), romSize);
   romFile.close();
 
+  // Battery Things
+  std::string batteryPath;
+  if (battery) {
+    batteryPath = filename;
+    batteryPath.replace(batteryPath.end() - 4, batteryPath.end(), ".sav");
+  }
+  loadCartridge(romData, romSize, batteryPath, std::cout);
+}
+
+void Memory::loadCartridge(BYTE *romData, unsigned int romSize,
+                           const std::string &batteryPath, std::ostream &log) {
+  romImage = romData;
+  romImageSize = romSize;
+
   // Print out ROM header information
 
   // Title
@@ -345,20 +388,20 @@ void Memory::loadCartridge(const std::string filename) {
   for (int i = 0; i < 16; i++) {
     title[i] = romData[0x0134 + i]; // Read the title from the ROM header
   }
-  std::cout << "Title: ";
+  log << "Title: ";
   for (int i = 0; i < 16; i++) {
-    std::cout << title[i]; // Print the title
+    log << title[i]; // Print the title
   }
-  std::cout << std::endl;
+  log << std::endl;
 
   // CGB Flag
   BYTE cgbFlag = romData[0x0143]; // Read the CGB flag from the ROM header
   if (cgbFlag == 0xC0 || cgbFlag == 0x80) {
     CBG = true; // Set CBG mode flag
-    std::cout << "CGB Mode: Yes" << std::endl;
+    log << "CGB Mode: Yes" << std::endl;
   } else {
     CBG = false; // Set CBG mode flag
-    std::cout << "CGB Mode: No" << std::endl;
+    log << "CGB Mode: No" << std::endl;
   }
 
   // ROM Size
@@ -371,9 +414,9 @@ void Memory::loadCartridge(const std::string filename) {
     romSizeValue = 0; // Invalid ROM size
   }
   if (romSizeValue != 0) {
-    std::cout << "ROM Size: " << romSizeValue << " KB" << std::endl;
+    log << "ROM Size: " << romSizeValue << " KB" << std::endl;
   } else {
-    std::cout << "Invalid ROM Size" << std::endl;
+    log << "Invalid ROM Size" << std::endl;
   }
 
   // RAM Size
@@ -408,114 +451,185 @@ void Memory::loadCartridge(const std::string filename) {
     break;
   }
   if (ramSizeValue != 0) {
-    std::cout << "RAM Size: " << ramSizeValue << " KB" << std::endl;
+    log << "RAM Size: " << ramSizeValue << " KB" << std::endl;
   } else {
-    std::cout << "Invalid RAM Size" << std::endl;
+    log << "Invalid RAM Size" << std::endl;
   }
-  ramSizeValue =
-      ramSizes[ramSizeFlag]; // Set the actual RAM size value in Bytes
-
-  // Battery Things
-  std::string batteryPath = filename;
-  batteryPath.replace(batteryPath.end() - 4, batteryPath.end(), ".sav");
+  // Set the actual RAM size value in Bytes
+  ramSizeValue = ramSizeFlag <= 0x05 ? ramSizes[ramSizeFlag] : 0;
 
   // MBC Type
   BYTE mbcType = romData[0x0147]; // Read the MBC type from the ROM header
-  std::cout << "MBC Type: ";
+  log << "MBC Type: ";
 
   // Switch case for MBC type
   switch (mbcType) {
   case 0x00:                                 // No MBC
     cartridge = new NOMBC(romData, romSize); // Create NoMBC object
-    std::cout << "No MBC" << std::endl;
+    log << "No MBC" << std::endl;
+    if (romSize > 0x8000) {
+      log << "ROM too large for NOMBC. We'll mask out but it will likely fail"
+          << std::endl;
+    }
     break;
   case 0x01:                                   // MBC1
     cartridge = new MBC1(romData, romSize, 0); // Create MBC1 object
-    std::cout << "MBC1" << std::endl;
+    log << "MBC1" << std::endl;
     break;
   case 0x02: // MBC1 + RAM
     cartridge =
         new MBC1(romData, romSize, ramSizeValue); // Create MBC1 + RAM object
-    std::cout << "MBC1 + RAM" << std::endl;
+    log << "MBC1 + RAM" << std::endl;
     break;
   case 0x03: // MBC1 + RAM + BATTERY
-    std::cout << "MBC1 + RAM + BATTERY" << std::endl;
+    log << "MBC1 + RAM + BATTERY" << std::endl;
     cartridge = new MBC1(romData, romSize,
                          ramSizeValue); // Create MBC1 + RAM + BATTERY object
-    cartridge->setBatteryLocation(batteryPath); // Set battery location
+    if (!batteryPath.empty()) {
+      cartridge->setBatteryLocation(batteryPath); // Set battery location
+    }
     break;
   case 0x0F: // MBC3 + TIMER + BATTERY
-    std::cout << "MBC3 + TIMER + BATTERY" << std::endl;
+    log << "MBC3 + TIMER + BATTERY" << std::endl;
     cartridge = new MBC3(romData, romSize, 0,
                          true); // Create MBC3 + TIMER + BATTERY object
-    cartridge->setBatteryLocation(batteryPath); // Set battery location
+    if (!batteryPath.empty()) {
+      cartridge->setBatteryLocation(batteryPath); // Set battery location
+    }
     break;
   case 0x10: // MBC3 + TIMER
-    std::cout << "MBC3 + TIMER" << std::endl;
+    log << "MBC3 + TIMER" << std::endl;
     cartridge = new MBC3(romData, romSize, 0,
                          true); // Create MBC3 + TIMER object
     break;
   case 0x11: // MBC3
-    std::cout << "MBC3" << std::endl;
+    log << "MBC3" << std::endl;
     cartridge = new MBC3(romData, romSize, 0,
                          false); // Create MBC3 object
     break;
   case 0x12: // MBC3 + RAM
-    std::cout << "MBC3 + RAM" << std::endl;
+    log << "MBC3 + RAM" << std::endl;
     cartridge = new MBC3(romData, romSize, ramSizeValue,
                          false); // Create MBC3 + RAM object
     break;
   case 0x13: // MBC3 + RAM + BATTERY
-    std::cout << "MBC3 + RAM + BATTERY" << std::endl;
+    log << "MBC3 + RAM + BATTERY" << std::endl;
     cartridge = new MBC3(romData, romSize, ramSizeValue,
                          false); // Create MBC3 + RAM + BATTERY object
-    cartridge->setBatteryLocation(batteryPath); // Set battery location
+    if (!batteryPath.empty()) {
+      cartridge->setBatteryLocation(batteryPath); // Set battery location
+    }
     break;
   case 0x19: // MBC5
-    std::cout << "MBC5" << std::endl;
+    log << "MBC5" << std::endl;
     cartridge = new MBC5(romData, romSize, 0); // Create MBC5 object
     break;
   case 0x1A: // MBC5 + RAM
-    std::cout << "MBC5 + RAM" << std::endl;
+    log << "MBC5 + RAM" << std::endl;
     cartridge = new MBC5(romData, romSize, ramSizeValue); // Create MBC5 + RAM
                                                           // object
     break;
   case 0x1B: // MBC5 + RAM + BATTERY
-    std::cout << "MBC5 + RAM + BATTERY" << std::endl;
+    log << "MBC5 + RAM + BATTERY" << std::endl;
     cartridge = new MBC5(romData, romSize, ramSizeValue); // Create MBC5 + RAM
                                                           // + BATTERY object
-    cartridge->setBatteryLocation(batteryPath); // Set battery location
+    if (!batteryPath.empty()) {
+      cartridge->setBatteryLocation(batteryPath); // Set battery location
+    }
     break;
   case 0x1C: // MBC5 + RUMBLE
-    std::cout << "MBC5 + RUMBLE" << std::endl;
+    log << "MBC5 + RUMBLE" << std::endl;
     cartridge = new MBC5(romData, romSize, 0); // Create MBC5 + RUMBLE object
     break;
   case 0x1D: // MBC5 + RUMBLE + RAM
-    std::cout << "MBC5 + RUMBLE + RAM" << std::endl;
+    log << "MBC5 + RUMBLE + RAM" << std::endl;
     cartridge =
         new MBC5(romData, romSize, ramSizeValue); // Create MBC5 + RUMBLE
                                                   // + RAM object
     break;
   case 0x1E: // MBC5 + RUMBLE + RAM + BATTERY
-    std::cout << "MBC5 + RUMBLE + RAM + BATTERY" << std::endl;
+    log << "MBC5 + RUMBLE + RAM + BATTERY" << std::endl;
     cartridge =
         new MBC5(romData, romSize, ramSizeValue); // Create MBC5 + RUMBLE +
                                                   // RAM + BATTERY object
-    cartridge->setBatteryLocation(batteryPath);   // Set battery location
+    if (!batteryPath.empty()) {
+      cartridge->setBatteryLocation(batteryPath);   // Set battery location
+    }
     break;
   default:
-    std::cout << "Unknown MBC Type" << std::endl;
+    log << "Unknown MBC Type" << std::endl;
+    cartridge = nullptr;
+    romImage = nullptr;
+    romImageSize = 0;
+    free(romData);
     break;
   }
 }
 
 void Memory::updateCycles(int cycles) {
   gpu->updateGPU(cycles);           // Update GPU cycles
-  apu->updateChannelTimers(cycles); // Update APU channel timers
-  apu->apuStep(cycles);             // Update APU
-  apu->getAudioSample(cycles); // Get APU audio sample
+  apu->update(cycles);              // Update APU
 }
 void Memory::updateTimers(int cycles) { timers->updateTimers(cycles); }
-void Memory::renderGPU(SDL_Renderer *ren) {
-  gpu->renderFrame(ren); // Render GPU frame
-}
\ No newline at end of file
+void Memory::renderGPU() {
+  gpu->renderFrame(); // Render GPU frame
+}
+void Memory::setVideoSink(VideoSink *sink) { gpu->setVideoSink(sink); }
+void Memory::setAudioSink(AudioSink *sink) { apu->setAudioSink(sink); }
+void Memory::setAudioFormat(int sampleRate, int blockSize) {
+  apu->setSampleRate(sampleRate);
+  apu->setBlockSize(blockSize);
+}
+void Memory::setAudioRateAdjust(double ratio) { apu->setRateAdjust(ratio); }
+void Memory::setAPULog(APULogWriter *log) { apu->setLog(log); }
+void Memory::setInputSource(InputSource *source) {
+  input->setInputSource(source);
+}
+void Memory::setRealTimeClock(bool enable) {
+  if (cartridge) {
+    cartridge->setRealTimeClock(enable);
+  }
+}
+
+void Memory::saveState(StateWriter &state) const {
+  state.beginSection("MEM ");
+  state.write(highRAM, sizeof(highRAM));
+  state.put(bootROM);
+  state.put(key1);
+  state.put(OAMDMA);
+  state.put(HDMA1);
+  state.put(HDMA2);
+  state.put(HDMA3);
+  state.put(HDMA4);
+  state.put(HDMA5);
+  state.endSection();
+
+  interrupts->saveState(state);
+  timers->saveState(state);
+  input->saveState(state);
+  wram->saveState(state);
+  gpu->saveState(state);
+  apu->saveState(state);
+  cartridge->saveState(state);
+}
+
+void Memory::loadState(StateReader &state) {
+  state.openSection("MEM ");
+  state.read(highRAM, sizeof(highRAM));
+  state.get(bootROM);
+  state.get(key1);
+  state.get(OAMDMA);
+  state.get(HDMA1);
+  state.get(HDMA2);
+  state.get(HDMA3);
+  state.get(HDMA4);
+  state.get(HDMA5);
+
+  interrupts->loadState(state);
+  timers->loadState(state);
+  input->loadState(state);
+  wram->loadState(state);
+  gpu->loadState(state);
+  apu->loadState(state);
+  cartridge->loadState(state);
+}
@@ -17,10 +17,15 @@ typedef uint8_t BYTE;
 typedef uint16_t WORD;
 typedef uint32_t DWORD;
 
+class StateWriter;
+class StateReader;
+
 class Memory {
 private:
   // Memory map
   Cartridge *cartridge;   // Pointer to the cartridge
+  const BYTE *romImage;   // ROM file the cartridge was made from (it owns it)
+  unsigned int romImageSize;
   BYTE highRAM[0x7F];     // High RAM (0xFF80 - 0xFFFF)
   WRAM *wram;             // WRAM object
   Interrupts *interrupts; // Interrupts object
@@ -36,9 +41,16 @@ private:
 
   void OAMDMATransfer();
   void VRAMDMATransfer();
+  void init();
+  void resetRegisters();
 
 public:
-  Memory(const std::string filename);
+  // battery = false ignores the save file (for extra instances of a game)
+  Memory(const std::string filename, bool battery = true);
+  // ROM image already in memory, copied. Nothing is printed and there is no
+  // save file, the cartridge is nullptr if its type is not supported.
+  Memory(const BYTE *romData, unsigned int romSize);
+  Memory(Cartridge *cartridge, bool CBG); // Takes ownership of the cartridge
   Memory(Cartridge *cartridge, Interrupts *interrupts, Timers *timers, GPU *gpu,
          Input *input, APU *apu, WRAM *wram, bool CBG);
   ~Memory();
@@ -50,10 +62,32 @@ public:
   WORD readWord(WORD address) const;
   void writeWord(WORD address, WORD value);
   void writeByteNoProtect(WORD address, BYTE value); // For testing
-  void loadCartridge(const std::string filename);
+  void loadCartridge(const std::string filename, bool battery = true);
+  // Takes ownership of romData, the header is described on log and an empty
+  // batteryPath means no save file
+  void loadCartridge(BYTE *romData, unsigned int romSize,
+                     const std::string &batteryPath, std::ostream &log);
+  bool hasCartridge() const { return cartridge != nullptr; }
+  // The ROM file as loaded, nullptr for cartridges built elsewhere (GBS)
+  const BYTE *getROM() const { return romImage; }
+  unsigned int getROMSize() const { return romImageSize; }
   void updateCycles(int cycles);
   void updateTimers(int cycles);
-  void renderGPU(SDL_Renderer *ren);
+  void renderGPU();
+
+  // Frontend connections
+  void setVideoSink(VideoSink *sink);
+  void setAudioSink(AudioSink *sink);
+  void setAudioFormat(int sampleRate, int blockSize);
+  void setAudioRateAdjust(double ratio);
+  void setAPULog(APULogWriter *log); // Record APU writes, nullptr to stop
+  void setInputSource(InputSource *source);
+  // Off stops a cartridge clock (MBC3) from following the system time
+  void setRealTimeClock(bool enable);
+
+  // Save states of everything on the bus (see SaveState.h for the CPU)
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
   GPU *gpu; // GPU object
 };
 
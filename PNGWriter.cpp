@@ -0,0 +1,102 @@
+#include "PNGWriter.h"
+#include <algorithm>
+#include <cstdio>
+
+PNGWriter::PNGWriter() {
+  // CRC-32 table used by the chunk checksums
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+    crcTable[n] = c;
+  }
+}
+
+uint32_t PNGWriter::crc(const uint8_t *data, size_t length,
+                        uint32_t crc) const {
+  for (size_t i = 0; i < length; i++) {
+    crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void putBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+void PNGWriter::writeChunk(std::vector<uint8_t> &file, const char *type,
+                           const std::vector<uint8_t> &data) const {
+  putBigEndian(file, data.size());
+  size_t start = file.size();
+  file.insert(file.end(), type, type + 4);
+  file.insert(file.end(), data.begin(), data.end());
+  uint32_t checksum =
+      crc(&file[start], file.size() - start, 0xFFFFFFFF) ^ 0xFFFFFFFF;
+  putBigEndian(file, checksum);
+}
+
+bool PNGWriter::write(const std::string &path, const uint32_t *pixels,
+                      int width, int height, int pitch) const {
+  // Raw scanlines, each starts with filter type 0 (none)
+  std::vector<uint8_t> raw;
+  raw.reserve((width * 3 + 1) * height);
+  for (int y = 0; y < height; y++) {
+    const uint32_t *row = reinterpret_cast<const uint32_t *>(
+        reinterpret_cast<const uint8_t *>(pixels) + y * pitch);
+    raw.push_back(0);
+    for (int x = 0; x < width; x++) {
+      raw.push_back(row[x] >> 16); // Red
+      raw.push_back(row[x] >> 8);  // Green
+      raw.push_back(row[x]);       // Blue
+    }
+  }
+
+  // zlib stream made of stored deflate blocks (at most 65535 bytes each)
+  std::vector<uint8_t> data = {0x78, 0x01};
+  size_t offset = 0;
+  do {
+    size_t length = std::min<size_t>(raw.size() - offset, 65535);
+    bool last = offset + length == raw.size();
+    data.push_back(last ? 1 : 0);
+    data.push_back(length & 0xFF);
+    data.push_back(length >> 8);
+    data.push_back(~length & 0xFF);
+    data.push_back((~length >> 8) & 0xFF);
+    data.insert(data.end(), raw.begin() + offset,
+                raw.begin() + offset + length);
+    offset += length;
+  } while (offset < raw.size());
+  // Adler-32 of the uncompressed data
+  uint32_t a = 1, b = 0;
+  for (uint8_t byte : raw) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  putBigEndian(data, (b << 16) | a);
+
+  std::vector<uint8_t> header;
+  putBigEndian(header, width);
+  putBigEndian(header, height);
+  header.push_back(8); // Bit depth
+  header.push_back(2); // Color type: RGB
+  header.push_back(0); // Compression
+  header.push_back(0); // Filter
+  header.push_back(0); // No interlace
+
+  std::vector<uint8_t> file = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  writeChunk(file, "IHDR", header);
+  writeChunk(file, "IDAT", data);
+  writeChunk(file, "IEND", {});
+
+  FILE *out = fopen(path.c_str(), "wb");
+  if (!out) {
+    return false;
+  }
+  bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+  fclose(out);
+  return written;
+}
@@ -0,0 +1,25 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Writes XRGB8888 images as PNG files without any library. The image data
+// is stored in uncompressed deflate blocks, which keeps the writer small;
+// the files are only meant for inspecting frames.
+class PNGWriter {
+private:
+  uint32_t crcTable[256];
+
+  uint32_t crc(const uint8_t *data, size_t length, uint32_t crc) const;
+  void writeChunk(std::vector<uint8_t> &file, const char *type,
+                  const std::vector<uint8_t> &data) const;
+
+public:
+  PNGWriter();
+  // pitch is in bytes, returns false if the file could not be written
+  bool write(const std::string &path, const uint32_t *pixels, int width,
+             int height, int pitch) const;
+};
+
+#endif
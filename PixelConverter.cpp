@@ -0,0 +1,139 @@
+#include "PixelConverter.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXELCONVERTER_X86
+#include <immintrin.h>
+#endif
+
+PixelConverter::PixelConverter(PixelFormat format) : format(format) {
+  switch (format) {
+  case PIXEL_XRGB8888:
+    bytesPerPixel = 4;
+    break;
+  case PIXEL_RGB565:
+    bytesPerPixel = 2;
+    break;
+  case PIXEL_GRAY8:
+    bytesPerPixel = 1;
+    break;
+  }
+#ifdef PIXELCONVERTER_X86
+  useSSSE3 = __builtin_cpu_supports("ssse3");
+#else
+  useSSSE3 = false;
+#endif
+  memset(colors, 0, sizeof(colors));
+  memset(planes, 0, sizeof(planes));
+}
+
+void PixelConverter::setPalette(const uint32_t *xrgb) {
+  for (int i = 0; i < 64; i++) {
+    uint32_t r = (xrgb[i] >> 16) & 0xFF;
+    uint32_t g = (xrgb[i] >> 8) & 0xFF;
+    uint32_t b = xrgb[i] & 0xFF;
+    switch (format) {
+    case PIXEL_XRGB8888:
+      colors[i] = xrgb[i];
+      break;
+    case PIXEL_RGB565:
+      colors[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+      break;
+    case PIXEL_GRAY8:
+      colors[i] = (r * 77 + g * 150 + b * 29) >> 8; // Rec. 601 weights
+      break;
+    }
+    // Little endian byte order of the output pixel
+    for (int plane = 0; plane < bytesPerPixel; plane++) {
+      planes[plane][i] = (colors[i] >> (plane * 8)) & 0xFF;
+    }
+  }
+}
+
+void PixelConverter::convertLine(const BYTE *indices, int count,
+                                 void *out) const {
+  BYTE *bytes = static_cast<BYTE *>(out);
+  int done = 0;
+  if (useSSSE3) {
+    done = count & ~15;
+    convertSSSE3(indices, done, bytes);
+  }
+  // Whatever is left (or everything without SSSE3)
+  for (int i = done; i < count; i++) {
+    BYTE index = indices[i];
+    uint32_t color = (index & 0x40) ? 0 : colors[index & 0x3F];
+    switch (format) {
+    case PIXEL_XRGB8888:
+      reinterpret_cast<uint32_t *>(bytes)[i] = color;
+      break;
+    case PIXEL_RGB565:
+      reinterpret_cast<uint16_t *>(bytes)[i] = color;
+      break;
+    case PIXEL_GRAY8:
+      bytes[i] = color;
+      break;
+    }
+  }
+}
+
+#ifdef PIXELCONVERTER_X86
+// Look up 16 indices (0-63) in a 64 entry byte table: pshufb covers 16
+// entries, so each quarter of the table is looked up and the right one kept
+__attribute__((target("ssse3"))) static inline __m128i
+lookup64(const BYTE *table, __m128i low, __m128i quarter[4]) {
+  __m128i result = _mm_setzero_si128();
+  for (int i = 0; i < 4; i++) {
+    __m128i entries =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(table + i * 16));
+    result = _mm_or_si128(
+        result, _mm_and_si128(quarter[i], _mm_shuffle_epi8(entries, low)));
+  }
+  return result;
+}
+
+__attribute__((target("ssse3"))) void
+PixelConverter::convertSSSE3(const BYTE *indices, int count, BYTE *out) const {
+  const __m128i lowMask = _mm_set1_epi8(0x0F);
+  const __m128i quarterMask = _mm_set1_epi8(0x30);
+  const __m128i blankMask = _mm_set1_epi8(0x40);
+  for (int i = 0; i < count; i += 16) {
+    __m128i index =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i));
+    __m128i low = _mm_and_si128(index, lowMask);
+    __m128i high = _mm_and_si128(index, quarterMask);
+    // Blank pixels match no quarter so they come out as 0
+    __m128i visible =
+        _mm_cmpeq_epi8(_mm_and_si128(index, blankMask), _mm_setzero_si128());
+    __m128i quarter[4];
+    for (int q = 0; q < 4; q++) {
+      quarter[q] = _mm_and_si128(
+          visible, _mm_cmpeq_epi8(high, _mm_set1_epi8(q << 4)));
+    }
+
+    __m128i *dest = reinterpret_cast<__m128i *>(out + i * bytesPerPixel);
+    if (bytesPerPixel == 1) {
+      _mm_storeu_si128(dest, lookup64(planes[0], low, quarter));
+    } else if (bytesPerPixel == 2) {
+      __m128i lo = lookup64(planes[0], low, quarter);
+      __m128i hi = lookup64(planes[1], low, quarter);
+      _mm_storeu_si128(dest, _mm_unpacklo_epi8(lo, hi));
+      _mm_storeu_si128(dest + 1, _mm_unpackhi_epi8(lo, hi));
+    } else {
+      __m128i b = lookup64(planes[0], low, quarter);
+      __m128i g = lookup64(planes[1], low, quarter);
+      __m128i r = lookup64(planes[2], low, quarter);
+      __m128i x = lookup64(planes[3], low, quarter);
+      __m128i bgLow = _mm_unpacklo_epi8(b, g);
+      __m128i bgHigh = _mm_unpackhi_epi8(b, g);
+      __m128i rxLow = _mm_unpacklo_epi8(r, x);
+      __m128i rxHigh = _mm_unpackhi_epi8(r, x);
+      _mm_storeu_si128(dest, _mm_unpacklo_epi16(bgLow, rxLow));
+      _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(bgLow, rxLow));
+      _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(bgHigh, rxHigh));
+      _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(bgHigh, rxHigh));
+    }
+  }
+}
+#else
+void PixelConverter::convertSSSE3(const BYTE *, int, BYTE *) const {}
+#endif
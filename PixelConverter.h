@@ -0,0 +1,31 @@
+#ifndef PIXELCONVERTER_H
+#define PIXELCONVERTER_H
+#include "Frontend.h"
+#include <cstdint>
+
+typedef uint8_t BYTE;
+
+// Converts lines of GPU palette indices into pixels through a 64 entry
+// color table. Indices with bit 6 set are blank and come out as 0.
+// On x86 CPUs with SSSE3 the table lookup is done 16 pixels at a time.
+class PixelConverter {
+private:
+  PixelFormat format;
+  int bytesPerPixel;
+  uint32_t colors[64];  // Table in the output format
+  BYTE planes[4][64];   // Same table split into byte planes for SIMD
+  bool useSSSE3;        // CPU supports the vector path
+
+  void convertSSSE3(const BYTE *indices, int count, BYTE *out) const;
+
+public:
+  PixelConverter(PixelFormat format);
+
+  // colors are 64 XRGB8888 values, one for each index
+  void setPalette(const uint32_t *colors);
+  // Convert count indices, out must hold count pixels in the format
+  void convertLine(const BYTE *indices, int count, void *out) const;
+  int getBytesPerPixel() const { return bytesPerPixel; }
+};
+
+#endif
@@ -0,0 +1,379 @@
+#include "PostProcessor.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void PostProcessor::Image::resize(int width, int height) {
+  if (this->width == width && this->height == height) {
+    return; // Keep the allocation between frames
+  }
+  this->width = width;
+  this->height = height;
+  pitch = width + 2;
+  pixels.assign(pitch * (height + 2), 0);
+}
+
+void PostProcessor::Image::fillBorder() {
+  for (int y = 0; y < height; y++) {
+    row(y)[-1] = row(y)[0];
+    row(y)[width] = row(y)[width - 1];
+  }
+  memcpy(row(-1) - 1, row(0) - 1, pitch * sizeof(uint32_t));
+  memcpy(row(height) - 1, row(height - 1) - 1, pitch * sizeof(uint32_t));
+}
+
+PostProcessor::PostProcessor(int threads)
+    : pool(nullptr), threads(threads), scaler(SCALER_NONE), nearestFactor(1),
+      lcdGrid(false), colorCorrection(false), frameBlend(false),
+      havePrevious(false) {
+  if (threads <= 0) {
+    this->threads =
+        std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+  }
+  source.width = source.height = 0;
+  scaled[0].width = scaled[0].height = 0;
+  scaled[1].width = scaled[1].height = 0;
+  source.resize(160, 144);
+  previous.assign(160 * 144, 0);
+  output = &source;
+}
+
+PostProcessor::~PostProcessor() { delete pool; }
+
+void PostProcessor::setScaler(Scaler scaler, int nearestFactor) {
+  this->scaler = scaler;
+  this->nearestFactor = std::max(1, nearestFactor);
+}
+
+bool PostProcessor::isActive() const {
+  return scaler != SCALER_NONE || lcdGrid || colorCorrection || frameBlend;
+}
+
+template <typename Kernel>
+void PostProcessor::forBands(int height, Kernel kernel) {
+  // A few bands per thread so a slow thread does not hold up the rest
+  int bands = std::min(height, pool->getThreadCount() * 2);
+  pool->parallelFor(bands, [&](int band) {
+    kernel(height * band / bands, height * (band + 1) / bands);
+  });
+}
+
+const uint32_t *PostProcessor::process(const uint32_t *frame, int pitch) {
+  if (!pool) {
+    pool = new ThreadPool(threads - 1); // The calling thread also works
+  }
+  correctAndBlend(frame, pitch);
+  output = &source;
+
+  int factor = 1;
+  switch (scaler) {
+  case SCALER_NONE:
+    break;
+  case SCALER_NEAREST:
+    factor = nearestFactor;
+    if (factor > 1) {
+      scaleNearest(source, scaled[0], factor);
+      output = &scaled[0];
+    }
+    break;
+  case SCALER_SCALE2X:
+    factor = 2;
+    source.fillBorder();
+    scale2x(source, scaled[0]);
+    output = &scaled[0];
+    break;
+  case SCALER_SCALE3X:
+    factor = 3;
+    source.fillBorder();
+    scale3x(source, scaled[0]);
+    output = &scaled[0];
+    break;
+  case SCALER_SCALE4X:
+    factor = 4;
+    source.fillBorder();
+    scale2x(source, scaled[0]);
+    scaled[0].fillBorder();
+    scale2x(scaled[0], scaled[1]);
+    output = &scaled[1];
+    break;
+  }
+
+  // Gaps only exist between scaled up pixels
+  if (lcdGrid && factor > 1) {
+    applyGrid(*output, factor);
+  }
+  return output->row(0);
+}
+
+// CGB color correction, the CGB screen mixes the channels and washes out
+// bright colors:
+//   r = (13r + 2g + b) / 16
+//   g = (3g + b) / 4
+//   b = (3r + 2g + 11b) / 16
+static inline uint32_t correctColor(uint32_t pixel) {
+  uint32_t r = (pixel >> 16) & 0xFF;
+  uint32_t g = (pixel >> 8) & 0xFF;
+  uint32_t b = pixel & 0xFF;
+  uint32_t newR = (r * 13 + g * 2 + b) >> 4;
+  uint32_t newG = (g * 3 + b) >> 2;
+  uint32_t newB = (r * 3 + g * 2 + b * 11) >> 4;
+  return (pixel & 0xFF000000) | (newR << 16) | (newG << 8) | newB;
+}
+
+// Average of two pixels per channel, rounding up like _mm_avg_epu8
+static inline uint32_t averagePixels(uint32_t a, uint32_t b) {
+  return (a | b) - (((a ^ b) >> 1) & 0x7F7F7F7F);
+}
+
+void PostProcessor::correctAndBlend(const uint32_t *frame, int pitch) {
+  bool blend = frameBlend && havePrevious;
+  forBands(144, [&](int first, int last) {
+    for (int y = first; y < last; y++) {
+      const uint32_t *in = reinterpret_cast<const uint32_t *>(
+          reinterpret_cast<const uint8_t *>(frame) + y * pitch);
+      uint32_t *out = source.row(y);
+      uint32_t *old = &previous[y * 160];
+      int x = 0;
+#ifdef __SSE2__
+      const __m128i byteMask = _mm_set1_epi32(0xFF);
+      const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+      for (; x < 160; x += 4) {
+        __m128i pixels =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x));
+        if (colorCorrection) {
+          __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+          __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask);
+          __m128i b = _mm_and_si128(pixels, byteMask);
+          // Products fit in the low 16 bits of each 32 bit lane
+          __m128i newR = _mm_srli_epi32(
+              _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(13)),
+                                          _mm_slli_epi32(g, 1)),
+                            b),
+              4);
+          __m128i newG = _mm_srli_epi32(
+              _mm_add_epi32(_mm_mullo_epi16(g, _mm_set1_epi32(3)), b), 2);
+          __m128i newB = _mm_srli_epi32(
+              _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(3)),
+                                          _mm_slli_epi32(g, 1)),
+                            _mm_mullo_epi16(b, _mm_set1_epi32(11))),
+              4);
+          pixels = _mm_or_si128(
+              _mm_or_si128(_mm_and_si128(pixels, alphaMask),
+                           _mm_slli_epi32(newR, 16)),
+              _mm_or_si128(_mm_slli_epi32(newG, 8), newB));
+        }
+        __m128i result = pixels;
+        if (blend) {
+          result = _mm_avg_epu8(
+              pixels, _mm_loadu_si128(reinterpret_cast<__m128i *>(old + x)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(old + x), pixels);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), result);
+      }
+#endif
+      for (; x < 160; x++) {
+        uint32_t pixel = colorCorrection ? correctColor(in[x]) : in[x];
+        out[x] = blend ? averagePixels(pixel, old[x]) : pixel;
+        old[x] = pixel;
+      }
+    }
+  });
+  havePrevious = true;
+}
+
+void PostProcessor::scaleNearest(Image &in, Image &out, int factor) {
+  out.resize(in.width * factor, in.height * factor);
+  forBands(in.height, [&](int first, int last) {
+    for (int y = first; y < last; y++) {
+      const uint32_t *src = in.row(y);
+      uint32_t *dest = out.row(y * factor);
+      int x = 0;
+#ifdef __SSE2__
+      if (factor == 2) {
+        for (; x < in.width; x += 4) {
+          __m128i pixels =
+              _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+          __m128i *to = reinterpret_cast<__m128i *>(dest + x * 2);
+          _mm_storeu_si128(to, _mm_unpacklo_epi32(pixels, pixels));
+          _mm_storeu_si128(to + 1, _mm_unpackhi_epi32(pixels, pixels));
+        }
+      } else if (factor == 4) {
+        for (; x < in.width; x++) {
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x * 4),
+                           _mm_set1_epi32(src[x]));
+        }
+      }
+#endif
+      for (; x < in.width; x++) {
+        for (int i = 0; i < factor; i++) {
+          dest[x * factor + i] = src[x];
+        }
+      }
+      // Repeat the row
+      for (int i = 1; i < factor; i++) {
+        memcpy(out.row(y * factor + i), dest, out.width * sizeof(uint32_t));
+      }
+    }
+  });
+}
+
+// Scale2x, for each pixel E with neighbours
+//     B
+//   D E F
+//     H
+// the four output pixels are
+//   E0 = D == B && B != F && D != H ? D : E
+//   E1 = B == F && B != D && F != H ? F : E
+//   E2 = D == H && D != B && H != F ? D : E
+//   E3 = H == F && D != H && B != F ? F : E
+void PostProcessor::scale2x(Image &in, Image &out) {
+  out.resize(in.width * 2, in.height * 2);
+  forBands(in.height, [&](int first, int last) {
+    for (int y = first; y < last; y++) {
+      const uint32_t *above = in.row(y - 1);
+      const uint32_t *center = in.row(y);
+      const uint32_t *below = in.row(y + 1);
+      uint32_t *top = out.row(y * 2);
+      uint32_t *bottom = out.row(y * 2 + 1);
+      int x = 0;
+#ifdef __SSE2__
+      for (; x + 4 <= in.width; x += 4) {
+        __m128i B = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x));
+        __m128i D =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(center + x - 1));
+        __m128i E = _mm_loadu_si128(reinterpret_cast<const __m128i *>(center + x));
+        __m128i F =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(center + x + 1));
+        __m128i H = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + x));
+        __m128i DB = _mm_cmpeq_epi32(D, B);
+        __m128i BF = _mm_cmpeq_epi32(B, F);
+        __m128i DH = _mm_cmpeq_epi32(D, H);
+        __m128i HF = _mm_cmpeq_epi32(H, F);
+        // Shared condition B != F && D != H, written as ~(BF | DH)
+        __m128i open = _mm_or_si128(BF, DH);
+        __m128i m0 = _mm_andnot_si128(open, DB);
+        __m128i m1 = _mm_andnot_si128(_mm_or_si128(DB, HF), BF);
+        __m128i m2 = _mm_andnot_si128(_mm_or_si128(DB, HF), DH);
+        __m128i m3 = _mm_andnot_si128(open, HF);
+        __m128i E0 = _mm_or_si128(_mm_and_si128(m0, D), _mm_andnot_si128(m0, E));
+        __m128i E1 = _mm_or_si128(_mm_and_si128(m1, F), _mm_andnot_si128(m1, E));
+        __m128i E2 = _mm_or_si128(_mm_and_si128(m2, D), _mm_andnot_si128(m2, E));
+        __m128i E3 = _mm_or_si128(_mm_and_si128(m3, F), _mm_andnot_si128(m3, E));
+        __m128i *topOut = reinterpret_cast<__m128i *>(top + x * 2);
+        __m128i *bottomOut = reinterpret_cast<__m128i *>(bottom + x * 2);
+        _mm_storeu_si128(topOut, _mm_unpacklo_epi32(E0, E1));
+        _mm_storeu_si128(topOut + 1, _mm_unpackhi_epi32(E0, E1));
+        _mm_storeu_si128(bottomOut, _mm_unpacklo_epi32(E2, E3));
+        _mm_storeu_si128(bottomOut + 1, _mm_unpackhi_epi32(E2, E3));
+      }
+#endif
+      for (; x < in.width; x++) {
+        uint32_t B = above[x], D = center[x - 1], E = center[x];
+        uint32_t F = center[x + 1], H = below[x];
+        top[x * 2] = (D == B && B != F && D != H) ? D : E;
+        top[x * 2 + 1] = (B == F && B != D && F != H) ? F : E;
+        bottom[x * 2] = (D == H && D != B && H != F) ? D : E;
+        bottom[x * 2 + 1] = (H == F && D != H && B != F) ? F : E;
+      }
+    }
+  });
+}
+
+// Scale3x, for each pixel E with neighbours
+//   A B C
+//   D E F
+//   G H I
+// corners follow Scale2x, edges also check the diagonal neighbours
+void PostProcessor::scale3x(Image &in, Image &out) {
+  out.resize(in.width * 3, in.height * 3);
+  forBands(in.height, [&](int first, int last) {
+    for (int y = first; y < last; y++) {
+      const uint32_t *above = in.row(y - 1);
+      const uint32_t *center = in.row(y);
+      const uint32_t *below = in.row(y + 1);
+      uint32_t *rows[3] = {out.row(y * 3), out.row(y * 3 + 1),
+                           out.row(y * 3 + 2)};
+      for (int x = 0; x < in.width; x++) {
+        uint32_t A = above[x - 1], B = above[x], C = above[x + 1];
+        uint32_t D = center[x - 1], E = center[x], F = center[x + 1];
+        uint32_t G = below[x - 1], H = below[x], I = below[x + 1];
+        bool topLeft = D == B && B != F && D != H;
+        bool topRight = B == F && B != D && F != H;
+        bool bottomLeft = D == H && D != B && H != F;
+        bool bottomRight = H == F && D != H && B != F;
+        uint32_t *out0 = rows[0] + x * 3;
+        uint32_t *out1 = rows[1] + x * 3;
+        uint32_t *out2 = rows[2] + x * 3;
+        out0[0] = topLeft ? D : E;
+        out0[1] = (topLeft && E != C) || (topRight && E != A) ? B : E;
+        out0[2] = topRight ? F : E;
+        out1[0] = (topLeft && E != G) || (bottomLeft && E != A) ? D : E;
+        out1[1] = E;
+        out1[2] = (topRight && E != I) || (bottomRight && E != C) ? F : E;
+        out2[0] = bottomLeft ? D : E;
+        out2[1] = (bottomLeft && E != I) || (bottomRight && E != G) ? H : E;
+        out2[2] = bottomRight ? F : E;
+      }
+    }
+  });
+}
+
+void PostProcessor::buildGrid(int width, int factor) {
+  // Factors out of 256 for each channel, the last row and column of every
+  // scaled pixel is darkened, the unused top byte is left alone
+  for (int gap = 0; gap < 2; gap++) {
+    gridFactors[gap].resize(width * 4);
+    for (int x = 0; x < width; x++) {
+      int factor256 = 256;
+      if (x % factor == factor - 1) {
+        factor256 = factor256 * 3 / 4;
+      }
+      if (gap) {
+        factor256 = factor256 * 3 / 4;
+      }
+      for (int channel = 0; channel < 4; channel++) {
+        gridFactors[gap][x * 4 + channel] = channel == 3 ? 256 : factor256;
+      }
+    }
+  }
+}
+
+void PostProcessor::applyGrid(Image &image, int factor) {
+  if ((int)gridFactors[0].size() != image.width * 4) {
+    buildGrid(image.width, factor);
+  }
+  forBands(image.height, [&](int first, int last) {
+    for (int y = first; y < last; y++) {
+      const uint16_t *factors = gridFactors[y % factor == factor - 1].data();
+      uint8_t *pixels = reinterpret_cast<uint8_t *>(image.row(y));
+      int x = 0;
+#ifdef __SSE2__
+      const __m128i zero = _mm_setzero_si128();
+      for (; x + 4 <= image.width; x += 4) {
+        __m128i *at = reinterpret_cast<__m128i *>(pixels + x * 4);
+        __m128i values = _mm_loadu_si128(at);
+        __m128i low = _mm_unpacklo_epi8(values, zero);
+        __m128i high = _mm_unpackhi_epi8(values, zero);
+        low = _mm_srli_epi16(
+            _mm_mullo_epi16(low, _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                                     factors + x * 4))),
+            8);
+        high = _mm_srli_epi16(
+            _mm_mullo_epi16(high,
+                            _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                                factors + x * 4 + 8))),
+            8);
+        _mm_storeu_si128(at, _mm_packus_epi16(low, high));
+      }
+#endif
+      for (int i = x * 4; i < image.width * 4; i++) {
+        pixels[i] = (pixels[i] * factors[i]) >> 8;
+      }
+    }
+  });
+}
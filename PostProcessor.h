@@ -0,0 +1,78 @@
+#ifndef POSTPROCESSOR_H
+#define POSTPROCESSOR_H
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Post-processing applied to XRGB8888 frames before they are presented.
+// The chain runs in this order, every step is optional:
+//   CGB color correction -> frame blend -> scaling -> LCD grid
+// Each step is split into row bands that run on a thread pool. It is meant
+// to run on the UI thread so it never holds up emulation.
+class PostProcessor {
+public:
+  enum Scaler {
+    SCALER_NONE,     // Keep 160x144
+    SCALER_NEAREST,  // Integer nearest neighbour
+    SCALER_SCALE2X,  // EPX / Scale2x
+    SCALER_SCALE3X,  // Scale3x
+    SCALER_SCALE4X   // Scale2x applied twice
+  };
+
+private:
+  // An image with a one pixel border around it, so kernels can read the
+  // neighbours of edge pixels without checks
+  struct Image {
+    std::vector<uint32_t> pixels;
+    int width, height, pitch; // pitch is in pixels, including the border
+    void resize(int width, int height);
+    uint32_t *row(int y) { return &pixels[(y + 1) * pitch + 1]; }
+    void fillBorder(); // Repeat the edge pixels into the border
+  };
+
+  ThreadPool *pool; // Created on the first frame
+  int threads;      // Threads to use, including the caller
+  Scaler scaler;
+  int nearestFactor;    // Factor for SCALER_NEAREST
+  bool lcdGrid;         // Darken the gaps between LCD pixels
+  bool colorCorrection; // Mimic the colors of the CGB screen
+  bool frameBlend;      // Mix with the previous frame (LCD ghosting)
+
+  Image source;          // Frame after color correction and blending
+  Image scaled[2];       // Scaler outputs (Scale4x uses both)
+  std::vector<uint32_t> previous; // Previous frame for blending
+  bool havePrevious;
+  std::vector<uint16_t> gridFactors[2]; // Per channel factors, normal and
+                                        // gap rows
+  Image *output;
+
+  // Run kernel(firstRow, lastRow) over row bands of height rows
+  template <typename Kernel> void forBands(int height, Kernel kernel);
+  void correctAndBlend(const uint32_t *frame, int pitch);
+  void scaleNearest(Image &in, Image &out, int factor);
+  void scale2x(Image &in, Image &out);
+  void scale3x(Image &in, Image &out);
+  void applyGrid(Image &image, int factor);
+  void buildGrid(int width, int factor);
+
+public:
+  PostProcessor(int threads = 0); // threads = 0 picks from the hardware
+  ~PostProcessor();
+
+  void setScaler(Scaler scaler, int nearestFactor = 1);
+  void setLCDGrid(bool enable) { lcdGrid = enable; }
+  void setColorCorrection(bool enable) { colorCorrection = enable; }
+  void setFrameBlend(bool enable) { frameBlend = enable; }
+  // True if any step is turned on
+  bool isActive() const;
+
+  // Process a 160x144 XRGB8888 frame, pitch is in bytes. The result stays
+  // valid until the next call.
+  const uint32_t *process(const uint32_t *frame, int pitch);
+  int getWidth() const { return output->width; }
+  int getHeight() const { return output->height; }
+  int getPitch() const { return output->pitch * sizeof(uint32_t); }
+};
+
+#endif
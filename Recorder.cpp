@@ -0,0 +1,227 @@
+#include "Recorder.h"
+#include <algorithm>
+#include <cstring>
+
+// Delta + RLE layout (.gbd), all values little endian:
+//   header: "GBD1", u16 width, u16 height, u32 frame rate numerator,
+//           u32 frame rate denominator
+//   frame:  u32 payload size in bytes, then runs until the frame is covered
+//   run:    u16 unchanged pixel count, u16 changed pixel count, then the
+//           changed pixels as 24-bit RGB
+// The first frame is compared against a black frame.
+
+Recorder::Recorder(VideoSink *nextVideo, AudioSink *nextAudio)
+    : nextVideo(nextVideo), nextAudio(nextAudio), recording(false),
+      format(FORMAT_RAW), videoFile(nullptr), framesRecorded(0),
+      framesDropped(0), audioBlocksDropped(0) {
+  videoRing = new SPSCQueue<VideoSlot, 8>();
+  audioRing = new SPSCQueue<AudioSlot, 64>();
+}
+
+Recorder::~Recorder() {
+  stop();
+  delete videoRing;
+  delete audioRing;
+}
+
+static void put16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(value);
+  out.push_back(value >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t value) {
+  put16(out, value);
+  put16(out, value >> 16);
+}
+
+bool Recorder::start(const std::string &basename, Format format,
+                     int sampleRate) {
+  stop();
+  this->format = format;
+  const char *extension =
+      format == FORMAT_Y4M ? ".y4m" : format == FORMAT_RAW ? ".rgb" : ".gbd";
+  videoFile = fopen((basename + extension).c_str(), "wb");
+  if (!videoFile) {
+    return false;
+  }
+  if (!wav.open(basename + ".wav", sampleRate)) {
+    fclose(videoFile);
+    videoFile = nullptr;
+    return false;
+  }
+
+  // Frame rate of the Game Boy: 4194304 Hz / 70224 cycles per frame
+  if (format == FORMAT_Y4M) {
+    fprintf(videoFile, "YUV4MPEG2 W160 H144 F4194304:70224 Ip A1:1 C444\n");
+  } else if (format == FORMAT_DELTA) {
+    std::vector<uint8_t> header = {'G', 'B', 'D', '1'};
+    put16(header, 160);
+    put16(header, 144);
+    put32(header, 4194304);
+    put32(header, 70224);
+    fwrite(header.data(), 1, header.size(), videoFile);
+  }
+  previousFrame.assign(160 * 144, 0);
+  encoded.reserve(160 * 144 * 4 + 1024);
+
+  framesRecorded = 0;
+  framesDropped = 0;
+  audioBlocksDropped = 0;
+  recording = true;
+  writer = std::thread(&Recorder::writerLoop, this);
+  return true;
+}
+
+void Recorder::stop() {
+  if (!recording) {
+    return;
+  }
+  recording = false;
+  wake.notify();
+  writer.join();
+  fclose(videoFile);
+  videoFile = nullptr;
+  wav.close();
+}
+
+void Recorder::presentFrame(const void *pixels, int pitch) {
+  if (nextVideo) {
+    nextVideo->presentFrame(pixels, pitch);
+  }
+  if (!recording) {
+    return;
+  }
+  VideoSlot *slot = videoRing->beginPush();
+  if (!slot) {
+    framesDropped++; // Writer is behind, never wait for it
+    return;
+  }
+  for (int y = 0; y < 144; y++) {
+    memcpy(&slot->pixels[y * 160],
+           static_cast<const uint8_t *>(pixels) + y * pitch,
+           160 * sizeof(uint32_t));
+  }
+  videoRing->commitPush();
+  framesRecorded++;
+  wake.notify();
+}
+
+void Recorder::queueSamples(const float *samples, int count) {
+  if (recording) {
+    AudioSlot *slot = audioRing->beginPush();
+    if (slot) {
+      slot->count = std::min(count, 2048);
+      memcpy(slot->samples, samples, slot->count * sizeof(float));
+      audioRing->commitPush();
+    } else {
+      audioBlocksDropped++;
+    }
+  }
+  // Passed on last, the real audio sink may wait to pace the emulator
+  if (nextAudio) {
+    nextAudio->queueSamples(samples, count);
+  }
+}
+
+void Recorder::writerLoop() {
+  while (true) {
+    bool stopping = !recording;
+    bool didWork = false;
+    // Audio first, it is small and keeps the WAV close to the video
+    while (AudioSlot *slot = audioRing->front()) {
+      wav.write(slot->samples, slot->count);
+      audioRing->releaseFront();
+      didWork = true;
+    }
+    if (VideoSlot *slot = videoRing->front()) {
+      writeFrame(slot->pixels);
+      videoRing->releaseFront();
+      didWork = true;
+    }
+    if (!didWork) {
+      if (stopping) {
+        return; // Everything queued before stop() is written
+      }
+      wake.wait();
+    }
+  }
+}
+
+void Recorder::writeFrame(const uint32_t *pixels) {
+  switch (format) {
+  case FORMAT_Y4M:
+    writeY4M(pixels);
+    break;
+  case FORMAT_RAW:
+    writeRaw(pixels);
+    break;
+  case FORMAT_DELTA:
+    writeDelta(pixels);
+    break;
+  }
+}
+
+void Recorder::writeY4M(const uint32_t *pixels) {
+  // Planar Y, Cb, Cr at full resolution
+  encoded.resize(160 * 144 * 3);
+  uint8_t *y = &encoded[0];
+  uint8_t *cb = &encoded[160 * 144];
+  uint8_t *cr = &encoded[160 * 144 * 2];
+  for (int i = 0; i < 160 * 144; i++) {
+    int r = (pixels[i] >> 16) & 0xFF;
+    int g = (pixels[i] >> 8) & 0xFF;
+    int b = pixels[i] & 0xFF;
+    y[i] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+    cb[i] = ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+    cr[i] = ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+  }
+  fputs("FRAME\n", videoFile);
+  fwrite(encoded.data(), 1, encoded.size(), videoFile);
+}
+
+void Recorder::writeRaw(const uint32_t *pixels) {
+  encoded.resize(160 * 144 * 3);
+  for (int i = 0; i < 160 * 144; i++) {
+    encoded[i * 3] = pixels[i] >> 16;    // Red
+    encoded[i * 3 + 1] = pixels[i] >> 8; // Green
+    encoded[i * 3 + 2] = pixels[i];      // Blue
+  }
+  fwrite(encoded.data(), 1, encoded.size(), videoFile);
+}
+
+void Recorder::writeDelta(const uint32_t *pixels) {
+  encoded.clear();
+  put32(encoded, 0); // Payload size, filled in below
+  int i = 0;
+  while (i < 160 * 144) {
+    // Unchanged pixels, then changed pixels, each run fits in 16 bits
+    int unchanged = 0;
+    while (i + unchanged < 160 * 144 && unchanged < 0xFFFF &&
+           ((pixels[i + unchanged] ^ previousFrame[i + unchanged]) &
+            0xFFFFFF) == 0) {
+      unchanged++;
+    }
+    i += unchanged;
+    int changed = 0;
+    while (i + changed < 160 * 144 && changed < 0xFFFF &&
+           ((pixels[i + changed] ^ previousFrame[i + changed]) & 0xFFFFFF) !=
+               0) {
+      changed++;
+    }
+    put16(encoded, unchanged);
+    put16(encoded, changed);
+    for (int j = i; j < i + changed; j++) {
+      encoded.push_back(pixels[j] >> 16);
+      encoded.push_back(pixels[j] >> 8);
+      encoded.push_back(pixels[j]);
+    }
+    i += changed;
+  }
+  uint32_t payload = encoded.size() - 4;
+  encoded[0] = payload;
+  encoded[1] = payload >> 8;
+  encoded[2] = payload >> 16;
+  encoded[3] = payload >> 24;
+  fwrite(encoded.data(), 1, encoded.size(), videoFile);
+  memcpy(previousFrame.data(), pixels, 160 * 144 * sizeof(uint32_t));
+}
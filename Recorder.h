@@ -0,0 +1,85 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+#include "Frontend.h"
+#include "SPSCQueue.h"
+#include "WAVWriter.h"
+#include "WakeSignal.h"
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records frames and audio to disk on a writer thread. It sits between the
+// core and the real sinks: everything is passed on unchanged, and a copy
+// goes into a ring of preallocated buffers. When the writer falls behind
+// the ring fills up and new frames (or audio blocks) are dropped and
+// counted, the emulation thread never waits on the disk.
+//
+// Video formats:
+//   FORMAT_Y4M    YUV4MPEG2, 4:4:4 (BT.601 full range), plays in most tools
+//   FORMAT_RAW    Raw 24-bit RGB frames, lossless
+//   FORMAT_DELTA  Lossless delta + RLE codec, see Recorder.cpp for the layout
+// Audio is always written as a 32-bit float stereo WAV file.
+class Recorder : public VideoSink, public AudioSink {
+public:
+  enum Format { FORMAT_Y4M, FORMAT_RAW, FORMAT_DELTA };
+
+private:
+  struct VideoSlot {
+    uint32_t pixels[160 * 144];
+  };
+  struct AudioSlot {
+    float samples[2048];
+    int count;
+  };
+
+  VideoSink *nextVideo; // Sinks everything is passed on to
+  AudioSink *nextAudio;
+
+  // Rings shared with the writer thread, allocated once
+  SPSCQueue<VideoSlot, 8> *videoRing;
+  SPSCQueue<AudioSlot, 64> *audioRing;
+
+  std::thread writer;
+  std::atomic<bool> recording;
+  WakeSignal wake; // New data for the writer
+
+  Format format;
+  FILE *videoFile;
+  WAVWriter wav;
+  std::vector<uint32_t> previousFrame; // Last frame written (delta codec)
+  std::vector<uint8_t> encoded;        // Output buffer of the writer
+
+  // Counters, written by the emulation thread and read by anyone
+  std::atomic<uint64_t> framesRecorded;
+  std::atomic<uint64_t> framesDropped;
+  std::atomic<uint64_t> audioBlocksDropped;
+
+  void writerLoop();
+  void writeFrame(const uint32_t *pixels);
+  void writeY4M(const uint32_t *pixels);
+  void writeRaw(const uint32_t *pixels);
+  void writeDelta(const uint32_t *pixels);
+
+public:
+  // Frames and audio are passed on to these (either can be null)
+  Recorder(VideoSink *nextVideo, AudioSink *nextAudio);
+  ~Recorder();
+
+  // Start writing basename.y4m/.rgb/.gbd and basename.wav
+  bool start(const std::string &basename, Format format,
+             int sampleRate = 44100);
+  void stop(); // Finish writing everything queued and close the files
+  bool isRecording() const { return recording; }
+
+  // Emulation thread
+  void presentFrame(const void *pixels, int pitch) override;
+  void queueSamples(const float *samples, int count) override;
+
+  uint64_t getFramesRecorded() const { return framesRecorded; }
+  uint64_t getFramesDropped() const { return framesDropped; }
+  uint64_t getAudioBlocksDropped() const { return audioBlocksDropped; }
+};
+
+#endif
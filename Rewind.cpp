@@ -0,0 +1,207 @@
+#include "Rewind.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// Delta layout, all values little endian:
+//   u32 size of the older snapshot
+//   runs until the snapshot is covered: varint count of unchanged bytes,
+//   varint count of changed bytes, then the changed bytes XOR the newer
+//   snapshot
+// Varints are 7 bits per byte, low bits first, top bit set on all but the
+// last byte. Most of a state is the same from one frame to the next, so a
+// delta is usually a few hundred bytes to a few KB.
+
+static void putVarint(std::vector<BYTE> &out, size_t value) {
+  while (value >= 0x80) {
+    out.push_back((BYTE)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((BYTE)value);
+}
+
+static size_t getVarint(const BYTE *&in) {
+  size_t value = 0;
+  int shift = 0;
+  while (*in & 0x80) {
+    value |= (size_t)(*in++ & 0x7F) << shift;
+    shift += 7;
+  }
+  value |= (size_t)*in++ << shift;
+  return value;
+}
+
+Rewind::Rewind(SaveState &saveState, size_t memoryLimit, int interval)
+    : saveState(saveState), memoryLimit(memoryLimit),
+      interval(interval < 1 ? 1 : interval), framesSinceCapture(0),
+      moved(true), pending(0), memoryUsed(0), snapshotCount(0),
+      running(true), captureCount(0), capturesDropped(0),
+      captureSeconds(0) {
+  captures = new SPSCQueue<Slot, 4>();
+  worker = std::thread(&Rewind::workerLoop, this);
+}
+
+Rewind::~Rewind() {
+  running = false;
+  wake.notify();
+  worker.join();
+  delete captures;
+}
+
+void Rewind::frameDone() {
+  moved = true;
+  if (++framesSinceCapture < interval) {
+    return;
+  }
+  framesSinceCapture = 0;
+  auto start = std::chrono::steady_clock::now();
+  Slot *slot = captures->beginPush();
+  if (!slot) {
+    capturesDropped++; // No free slot, this snapshot is skipped
+    return;
+  }
+  saveState.save(slot->state);
+  pending++;
+  captures->commitPush();
+  wake.notify();
+  moved = false;
+  captureCount++;
+  captureSeconds += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+}
+
+bool Rewind::stepBack() {
+  // Every capture has to be in the ring first
+  while (pending > 0) {
+    std::this_thread::yield();
+  }
+
+  std::lock_guard<std::mutex> guard(ringLock);
+  if (newest.empty()) {
+    return false;
+  }
+  // The newest snapshot is the first step back, unless it is already what
+  // the machine was last loaded with
+  if (!moved && !deltas.empty()) {
+    memoryUsed -= deltas.back().size();
+    applyDelta(deltas.back(), newest);
+    deltas.pop_back();
+    snapshotCount--;
+  }
+  moved = false;
+  framesSinceCapture = 0;
+  return saveState.load(newest);
+}
+
+void Rewind::workerLoop() {
+  while (true) {
+    bool stopping = !running;
+    if (Slot *slot = captures->front()) {
+      addSnapshot(slot->state);
+      captures->releaseFront();
+      pending--;
+      continue;
+    }
+    if (stopping) {
+      return;
+    }
+    wake.wait();
+  }
+}
+
+void Rewind::addSnapshot(const std::vector<BYTE> &state) {
+  std::lock_guard<std::mutex> guard(ringLock);
+  size_t used = memoryUsed;
+  if (!newest.empty()) {
+    encodeDelta(newest, state, encoded);
+    deltas.emplace_back(encoded.begin(), encoded.end());
+    used += encoded.size();
+  }
+  used += state.size();
+  used -= newest.size();
+  newest = state;
+  size_t count = deltas.size() + 1;
+
+  // Forget the oldest snapshots until everything fits
+  while (used > memoryLimit && !deltas.empty()) {
+    used -= deltas.front().size();
+    deltas.pop_front();
+    count--;
+  }
+  memoryUsed = used;
+  snapshotCount = count;
+}
+
+void Rewind::encodeDelta(const std::vector<BYTE> &older,
+                         const std::vector<BYTE> &newer,
+                         std::vector<BYTE> &out) {
+  // XOR the two, the part of older past the end of newer is kept as it is
+  size_t size = older.size();
+  size_t common = std::min(size, newer.size());
+  difference.resize(size);
+  BYTE *d = difference.data();
+  for (size_t i = 0; i < common; i++) {
+    d[i] = older[i] ^ newer[i];
+  }
+  memcpy(d + common, older.data() + common, size - common);
+
+  out.clear();
+  uint32_t length = size;
+  out.insert(out.end(), (BYTE *)&length, (BYTE *)&length + 4);
+  size_t i = 0;
+  while (i < size) {
+    // Unchanged bytes, eight at a time while possible
+    size_t start = i;
+    uint64_t word;
+    while (i + 8 <= size && (memcpy(&word, d + i, 8), word == 0)) {
+      i += 8;
+    }
+    while (i < size && d[i] == 0) {
+      i++;
+    }
+    // Changed bytes, up to the next run of four unchanged ones. Shorter
+    // gaps cost less as part of the changed bytes than as a new run.
+    size_t end = i;
+    while (end < size) {
+      if (d[end] != 0) {
+        end++;
+        continue;
+      }
+      size_t zeros = end;
+      while (zeros < size && zeros < end + 4 && d[zeros] == 0) {
+        zeros++;
+      }
+      if (zeros == size || zeros == end + 4) {
+        break;
+      }
+      end = zeros;
+    }
+    putVarint(out, i - start);
+    putVarint(out, end - i);
+    out.insert(out.end(), d + i, d + end);
+    i = end;
+  }
+}
+
+void Rewind::applyDelta(const std::vector<BYTE> &delta,
+                        std::vector<BYTE> &state) {
+  uint32_t size;
+  memcpy(&size, delta.data(), 4);
+  state.resize(size, 0); // Bytes past the end of newer were XORed with 0
+  const BYTE *in = delta.data() + 4;
+  const BYTE *end = delta.data() + delta.size();
+  size_t position = 0;
+  while (in < end) {
+    position += getVarint(in);
+    size_t count = getVarint(in);
+    if (position + count > size || count > (size_t)(end - in)) {
+      return; // Damaged, cannot happen with deltas made by encodeDelta
+    }
+    for (size_t i = 0; i < count; i++) {
+      state[position + i] ^= in[i];
+    }
+    in += count;
+    position += count;
+  }
+}
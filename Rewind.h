@@ -0,0 +1,88 @@
+#ifndef REWIND_H
+#define REWIND_H
+#include "SPSCQueue.h"
+#include "SaveState.h"
+#include "WakeSignal.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keeps the recent past of the machine so it can be played backwards.
+// Every interval frames the emulation thread saves a state into a ring of
+// preallocated slots, which is a plain copy of a few microseconds. A worker
+// thread then turns it into an XOR delta against the previous snapshot,
+// run-length encoded (see Rewind.cpp for the layout). Deltas point back in
+// time: the newest snapshot is kept whole and each older one is rebuilt
+// from the one after it, so the oldest can be dropped at any time to stay
+// under the memory limit.
+class Rewind {
+private:
+  struct Slot {
+    std::vector<BYTE> state;
+  };
+
+  SaveState &saveState;
+  size_t memoryLimit; // Bytes for the whole snapshot and all deltas
+  int interval;       // Frames between snapshots
+  int framesSinceCapture;
+  bool moved; // Machine ran on since the newest snapshot was taken or loaded
+
+  // Emulation thread to worker
+  SPSCQueue<Slot, 4> *captures;
+  std::atomic<int> pending; // Captures the worker has not finished
+
+  // Owned by the worker, or by stepBack while it holds ringLock
+  std::mutex ringLock;
+  std::vector<BYTE> newest;             // Newest snapshot, whole
+  std::deque<std::vector<BYTE>> deltas; // Older snapshots, newest at the back
+  std::vector<BYTE> difference;         // XOR of two snapshots
+  std::vector<BYTE> encoded;            // Delta being built
+  std::atomic<size_t> memoryUsed;
+  std::atomic<size_t> snapshotCount;
+
+  std::thread worker;
+  std::atomic<bool> running;
+  WakeSignal wake; // New captures for the worker
+
+  // Statistics, emulation thread
+  uint64_t captureCount;
+  uint64_t capturesDropped;
+  double captureSeconds;
+
+  void workerLoop();
+  void addSnapshot(const std::vector<BYTE> &state);
+  // Delta that rebuilds older from newer
+  void encodeDelta(const std::vector<BYTE> &older,
+                   const std::vector<BYTE> &newer, std::vector<BYTE> &out);
+  // Turns newer into the older snapshot the delta was made from
+  static void applyDelta(const std::vector<BYTE> &delta,
+                         std::vector<BYTE> &state);
+
+public:
+  // memoryLimit is in bytes, e.g. 64 MB holds about ten minutes of most
+  // games at one snapshot per frame
+  Rewind(SaveState &saveState, size_t memoryLimit, int interval = 1);
+  ~Rewind();
+
+  // Emulation thread, after every frame that ran forward
+  void frameDone();
+  // Emulation thread, load the snapshot before the current one, going back
+  // interval frames. Stays on the oldest snapshot once it is reached.
+  // Returns false if there is nothing to go back to.
+  bool stepBack();
+
+  size_t getMemoryUsed() const { return memoryUsed; }
+  size_t getSnapshotCount() const { return snapshotCount; }
+  int getInterval() const { return interval; }
+  uint64_t getCaptureCount() const { return captureCount; }
+  uint64_t getCapturesDropped() const { return capturesDropped; }
+  // Average time a capture took on the emulation thread
+  double getCaptureTime() const {
+    return captureCount ? captureSeconds / captureCount : 0;
+  }
+};
+
+#endif
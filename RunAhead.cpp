@@ -0,0 +1,118 @@
+#include "RunAhead.h"
+#include <utility>
+
+RunAhead::RunAhead(CPU &cpu, Memory &memory, int frames, InputSource *input,
+                   VideoSink *videoSink, AudioSink *audioSink)
+    : cpu(cpu), memory(memory), saveState(cpu, memory),
+      frames(frames < 1 ? 1 : frames), input(input), videoSink(videoSink),
+      audioSink(audioSink), aheadMemory(nullptr), aheadCPU(nullptr),
+      aheadState(nullptr), mailboxButtons(0), mailboxFull(false),
+      stopping(false), statesSkipped(0) {}
+
+RunAhead::~RunAhead() {
+  if (aheadMemory) {
+    {
+      std::lock_guard<std::mutex> guard(mailboxLock);
+      stopping = true;
+    }
+    mailboxReady.notify_one();
+    worker.join();
+    delete aheadState;
+    delete aheadCPU;
+    delete aheadMemory;
+  }
+}
+
+bool RunAhead::startSecondInstance() {
+  if (aheadMemory) {
+    return true;
+  }
+  if (!memory.getROM()) {
+    return false;
+  }
+  // Same game without its save file, every frame starts from a loaded state
+  aheadMemory = new Memory(memory.getROM(), memory.getROMSize());
+  if (!aheadMemory->hasCartridge()) {
+    delete aheadMemory;
+    aheadMemory = nullptr;
+    return false;
+  }
+  aheadCPU = new CPU(*aheadMemory);
+  aheadState = new SaveState(*aheadCPU, *aheadMemory);
+  std::vector<BYTE> check;
+  saveState.save(check);
+  if (!aheadState->load(check)) {
+    delete aheadState;
+    delete aheadCPU;
+    delete aheadMemory;
+    aheadMemory = nullptr;
+    return false;
+  }
+  aheadMemory->setVideoSink(videoSink);
+  aheadMemory->setInputSource(&aheadButtons);
+  // The real machine is never shown, the second instance draws every frame
+  memory.setVideoSink(nullptr);
+  worker = std::thread(&RunAhead::workerLoop, this);
+  return true;
+}
+
+void RunAhead::runFrame() {
+  // The real frame, heard but not drawn
+  memory.gpu->skipNextFrame();
+  cpu.runFrame();
+
+  if (aheadMemory) {
+    // Hand the state over, a state the worker has not started on yet is
+    // simply replaced by the newer one
+    BYTE buttons = input ? input->getButtons() : 0;
+    saveState.save(state);
+    {
+      std::lock_guard<std::mutex> guard(mailboxLock);
+      if (mailboxFull) {
+        statesSkipped++;
+      }
+      std::swap(state, mailbox);
+      mailboxButtons = buttons;
+      mailboxFull = true;
+    }
+    mailboxReady.notify_one();
+    return;
+  }
+
+  // The frames ahead, drawn but not heard, then back to the real frame
+  saveState.save(state);
+  memory.setAudioSink(nullptr);
+  for (int i = 1; i < frames; i++) {
+    memory.gpu->skipNextFrame();
+    cpu.runFrame();
+  }
+  cpu.runFrame();
+  memory.renderGPU();
+  memory.setAudioSink(audioSink);
+  saveState.load(state);
+}
+
+void RunAhead::workerLoop() {
+  std::vector<BYTE> work;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(mailboxLock);
+      mailboxReady.wait(guard, [this]() { return mailboxFull || stopping; });
+      if (stopping) {
+        return;
+      }
+      std::swap(work, mailbox);
+      aheadButtons.buttons = mailboxButtons;
+      mailboxFull = false;
+    }
+    // The state is the real machine after its frame, so frames more frames
+    // are needed and only the last one is drawn
+    aheadState->load(work);
+    for (int i = 1; i < frames; i++) {
+      aheadMemory->gpu->skipNextFrame();
+      aheadCPU->runFrame();
+    }
+    aheadCPU->runFrame();
+    aheadMemory->renderGPU();
+  }
+}
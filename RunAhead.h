@@ -0,0 +1,70 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+#include "CPU.h"
+#include "Frontend.h"
+#include "Memory.h"
+#include "SaveState.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hides the frames of input lag built into most games by showing the
+// future. Each frame the real machine runs one frame with the current
+// buttons and saves its state, then more frames are run from that state
+// with the same buttons held and only the last of them is shown. The real
+// machine goes on from the saved state, so the game sees exactly the input
+// it would have without run-ahead, only the picture comes from later.
+// Audio comes from the real frames alone.
+// On one thread this costs frames + 1 emulated frames per frame. With a
+// second instance the speculative frames run on a worker thread on their
+// own copy of the machine, and the real machine only pays for a save.
+class RunAhead {
+private:
+  CPU &cpu;
+  Memory &memory;
+  SaveState saveState;
+  int frames;            // Frames shown ahead of the real machine
+  InputSource *input;    // Buttons of the real machine
+  VideoSink *videoSink;  // Where the frames ahead are presented
+  AudioSink *audioSink;  // Where the audio of the real frames goes
+  std::vector<BYTE> state; // Real machine after its frame
+
+  // Second instance, fed the newest state by the emulation thread
+  Memory *aheadMemory;
+  CPU *aheadCPU;
+  SaveState *aheadState;
+  HeldButtons aheadButtons; // Handed over along with each state
+  std::thread worker;
+  std::mutex mailboxLock;
+  std::condition_variable mailboxReady;
+  std::vector<BYTE> mailbox; // Newest state not yet taken by the worker
+  BYTE mailboxButtons;
+  bool mailboxFull;
+  bool stopping;
+  uint64_t statesSkipped; // Replaced in the mailbox before the worker ran
+
+  void workerLoop();
+
+public:
+  // The sinks are the ones set on memory, run-ahead switches between them
+  RunAhead(CPU &cpu, Memory &memory, int frames, InputSource *input,
+           VideoSink *videoSink, AudioSink *audioSink);
+  ~RunAhead();
+
+  // Run the frames ahead on a second copy of the game on its own thread,
+  // made from the ROM the real machine loaded. Returns false if it has none
+  // (a GBS file) or the copy could not be started.
+  bool startSecondInstance();
+  bool hasSecondInstance() const { return aheadMemory != nullptr; }
+
+  // Emulation thread, in place of running and presenting a frame
+  void runFrame();
+
+  int getFrames() const { return frames; }
+  uint64_t getStatesSkipped() const { return statesSkipped; }
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "SDLFrontend.h"
+#include "APU/APU.h"
+
+// Video
+SDLVideoSink::SDLVideoSink(SDL_Renderer *ren)
+    : ren(ren), textureWidth(160), textureHeight(144) {
+  // Gameboy screen: 160x144
+  // The texture lives for the whole run so presenting a frame does not
+  // allocate anything
+  texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGB888,
+                              SDL_TEXTUREACCESS_STREAMING, 160, 144);
+}
+
+SDLVideoSink::~SDLVideoSink() { SDL_DestroyTexture(texture); }
+
+void SDLVideoSink::presentFrame(const void *pixels, int pitch) {
+  presentImage(pixels, 160, 144, pitch);
+}
+
+void SDLVideoSink::presentImage(const void *pixels, int width, int height,
+                                int pitch) {
+  if (width != textureWidth || height != textureHeight) {
+    SDL_DestroyTexture(texture);
+    texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGB888,
+                                SDL_TEXTUREACCESS_STREAMING, width, height);
+    textureWidth = width;
+    textureHeight = height;
+  }
+  // Upload the whole frame buffer in one go
+  SDL_UpdateTexture(texture, NULL, pixels, pitch);
+  SDL_RenderClear(ren);
+  SDL_RenderCopy(ren, texture, NULL, NULL);
+  SDL_RenderPresent(ren);
+}
+
+// Audio
+SDLAudioSink::SDLAudioSink(int sampleRate, int deviceFrames) {
+  // Set up SDL audio spec
+  SDL_AudioSpec audioSpec;
+  SDL_memset(&audioSpec, 0, sizeof(audioSpec));
+  audioSpec.freq = sampleRate;
+  audioSpec.format = AUDIO_F32SYS;
+  audioSpec.channels = 2;            // Stereo
+  audioSpec.samples = deviceFrames;  // Frames per callback
+  audioSpec.callback = audioCallback;
+  audioSpec.userdata = this;
+
+  // SDL converts if the hardware wants something else, so the rate and
+  // format are always what was asked for
+  SDL_AudioSpec obtainedSpec;
+  device = SDL_OpenAudioDevice(NULL, 0, &audioSpec, &obtainedSpec, 0);
+  this->sampleRate = sampleRate;
+  this->deviceFrames = device ? obtainedSpec.samples : deviceFrames;
+  SDL_PauseAudioDevice(device, 0);
+}
+
+SDLAudioSink::~SDLAudioSink() { SDL_CloseAudioDevice(device); }
+
+// Runs on the SDL audio thread
+void SDLAudioSink::audioCallback(void *userdata, Uint8 *stream, int len) {
+  SDLAudioSink *sink = (SDLAudioSink *)userdata;
+  sink->ring.read((float *)stream, len / sizeof(float));
+}
+
+void SDLAudioSink::queueSamples(const float *samples, int count) {
+  ring.write(samples, count);
+}
+
+// Input
+BYTE SDLInputSource::getButtons() {
+  const Uint8 *keys = SDL_GetKeyboardState(NULL);
+  BYTE buttons = 0;
+  buttons |= keys[SDL_SCANCODE_RIGHT] ? BUTTON_RIGHT : 0;
+  buttons |= keys[SDL_SCANCODE_LEFT] ? BUTTON_LEFT : 0;
+  buttons |= keys[SDL_SCANCODE_UP] ? BUTTON_UP : 0;
+  buttons |= keys[SDL_SCANCODE_DOWN] ? BUTTON_DOWN : 0;
+  buttons |= keys[SDL_SCANCODE_Z] ? BUTTON_A : 0;
+  buttons |= keys[SDL_SCANCODE_X] ? BUTTON_B : 0;
+  buttons |= keys[SDL_SCANCODE_RETURN] ? BUTTON_SELECT : 0;
+  buttons |= keys[SDL_SCANCODE_SPACE] ? BUTTON_START : 0;
+  return buttons;
+}
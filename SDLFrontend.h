@@ -0,0 +1,67 @@
+#ifndef SDLFRONTEND_H
+#define SDLFRONTEND_H
+#include "AudioRing.h"
+#include "Frontend.h"
+#include <SDL2/SDL.h>
+
+// SDL implementations of the frontend interfaces
+
+// Presents frames through a single streaming texture
+class SDLVideoSink : public VideoSink {
+private:
+  SDL_Renderer *ren;    // Renderer the frames are drawn with
+  SDL_Texture *texture; // Streaming texture the frame is uploaded to
+  int textureWidth;     // Size of the texture
+  int textureHeight;
+
+public:
+  SDLVideoSink(SDL_Renderer *ren);
+  ~SDLVideoSink();
+  void presentFrame(const void *pixels, int pitch) override;
+  // Present an XRGB8888 image of any size (post-processed frames), the
+  // texture is only recreated when the size changes
+  void presentImage(const void *pixels, int width, int height, int pitch);
+};
+
+// Plays audio on an SDL audio device. Samples from the APU go into a
+// lock-free ring that the device callback drains, so queueSamples never
+// blocks; the emulation loop keeps real time by watching getQueuedSamples
+class SDLAudioSink : public AudioSink {
+private:
+  SDL_AudioDeviceID device; // Opened audio device
+  int sampleRate;           // Output rate in Hz
+  int deviceFrames;         // Frames the device asks for per callback
+  AudioRing<65536> ring;    // About 340 ms of stereo audio at 96 kHz
+
+  static void audioCallback(void *userdata, Uint8 *stream, int len);
+
+public:
+  SDLAudioSink(int sampleRate = 44100, int deviceFrames = 512);
+  ~SDLAudioSink();
+  void queueSamples(const float *samples, int count) override;
+
+  int getSampleRate() const { return sampleRate; }
+  int getDeviceFrames() const { return deviceFrames; }
+  int getQueuedSamples() const { return ring.getQueued(); }
+  int getCapacity() const { return ring.getCapacity(); }
+  // Time until a sample queued now is heard: the ring plus one device buffer
+  double getLatency() const {
+    return (ring.getQueued() / 2 + deviceFrames) / (double)sampleRate;
+  }
+  uint64_t getUnderruns() const { return ring.getUnderruns(); }
+  uint64_t getOverruns() const { return ring.getOverruns(); }
+};
+
+// Reads the keyboard state
+// Game Boy     Computer
+// D pad        Arrow keys
+// A            Z
+// B            X
+// Select       Enter
+// Start        Space
+class SDLInputSource : public InputSource {
+public:
+  BYTE getButtons() override;
+};
+
+#endif
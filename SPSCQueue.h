@@ -0,0 +1,70 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+#include <atomic>
+
+// Lock-free single producer / single consumer queue with a fixed capacity.
+// Size must be a power of two.
+template <typename T, unsigned int Size> class SPSCQueue {
+private:
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+  T items[Size];
+  // Kept on separate cache lines so the two threads do not fight over them
+  alignas(64) std::atomic<unsigned int> head; // Next item to read
+  alignas(64) std::atomic<unsigned int> tail; // Next slot to write
+
+public:
+  SPSCQueue() : head(0), tail(0) {}
+
+  // Producer side, returns false if the queue is full
+  bool push(const T &item) {
+    unsigned int t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Size) {
+      return false;
+    }
+    items[t & (Size - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Producer side, in place: get the next free slot (nullptr if the queue
+  // is full), fill it, then commit it. Avoids copying large items twice.
+  T *beginPush() {
+    unsigned int t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Size) {
+      return nullptr;
+    }
+    return &items[t & (Size - 1)];
+  }
+  void commitPush() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  // Consumer side, in place: look at the oldest item (nullptr if the queue
+  // is empty), then release it once done
+  T *front() {
+    unsigned int h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &items[h & (Size - 1)];
+  }
+  void releaseFront() {
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  // Consumer side, returns false if the queue is empty
+  bool pop(T &item) {
+    unsigned int h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[h & (Size - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "SaveState.h"
+#include "StateIO.h"
+#include <cstring>
+#include <fstream>
+
+SaveState::SaveState(CPU &cpu, Memory &memory) : cpu(cpu), memory(memory) {}
+
+void SaveState::writeHeader(std::vector<BYTE> &data) const {
+  StateWriter writer(data);
+  writer.write("GBST", 4);
+  writer.put(version);
+  writer.put((uint16_t)(memory.CBG ? 1 : 0));
+  for (WORD address = 0x134; address < 0x150; address++) {
+    writer.put(memory.readByte(address));
+  }
+}
+
+void SaveState::save(std::vector<BYTE> &data) const {
+  data.clear();
+  writeHeader(data);
+  StateWriter writer(data);
+  cpu.saveState(writer);
+  memory.saveState(writer);
+}
+
+bool SaveState::load(const std::vector<BYTE> &data) {
+  // Only states of this game in this mode
+  std::vector<BYTE> header;
+  writeHeader(header);
+  if (data.size() < headerSize ||
+      memcmp(data.data(), header.data(), headerSize) != 0) {
+    return false;
+  }
+
+  save(backup);
+  StateReader reader(data.data(), data.size(), headerSize);
+  cpu.loadState(reader);
+  memory.loadState(reader);
+  reader.closeSection();
+  if (!reader.ok()) {
+    // A section was missing or short, go back to where we were
+    StateReader restore(backup.data(), backup.size(), headerSize);
+    cpu.loadState(restore);
+    memory.loadState(restore);
+    return false;
+  }
+  return true;
+}
+
+bool SaveState::saveFile(const std::string &path) const {
+  std::vector<BYTE> data;
+  save(data);
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  file.write((const char *)data.data(), data.size());
+  return file.good();
+}
+
+bool SaveState::loadFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::vector<BYTE> data(file.tellg());
+  file.seekg(0, std::ios::beg);
+  file.read((char *)data.data(), data.size());
+  return file.good() && load(data);
+}
@@ -0,0 +1,46 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+#include "CPU.h"
+#include "Memory.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Saves and loads the whole machine to memory or a file.
+// Layout (little endian):
+//   0x00  "GBST"
+//   0x04  version (uint16)
+//   0x06  flags (uint16), bit 0 set in CGB mode
+//   0x08  ROM header 0x134-0x14F (title to global checksum)
+//   0x24  sections, see StateIO.h: CPU, then Memory and everything it owns
+// A state only loads into the same game in the same mode, and only with the
+// same version. Sections are found by tag, so a new section can be added
+// without changing the version (older builds skip it, though newer builds
+// cannot load states made before it). The version changes when the fields
+// of an existing section change, every section must be read to its end.
+// Settings (frame skip, sample rate, sinks) are not part of a state.
+class SaveState {
+private:
+  CPU &cpu;
+  Memory &memory;
+  std::vector<BYTE> backup; // State before a load, put back if it fails
+
+  void writeHeader(std::vector<BYTE> &data) const;
+
+public:
+  static constexpr uint16_t version = 1;
+  static constexpr size_t headerSize = 0x24;
+
+  SaveState(CPU &cpu, Memory &memory);
+
+  // Replaces data with the current state, reusing its allocation
+  void save(std::vector<BYTE> &data) const;
+  // Loads a state made by save, leaves the machine as it was and returns
+  // false if the state is damaged or belongs to another game
+  bool load(const std::vector<BYTE> &data);
+
+  bool saveFile(const std::string &path) const;
+  bool loadFile(const std::string &path);
+};
+
+#endif
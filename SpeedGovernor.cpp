@@ -0,0 +1,91 @@
+#include "SpeedGovernor.h"
+#include <algorithm>
+#include <thread>
+
+// Largest change to the audio resampling ratio used to steer the queue
+static const double maxRateAdjust = 0.005;
+
+// Length of one Game Boy frame in seconds (70224 cycles at 4.194304 MHz)
+static const double frameTime = 70224.0 / 4194304.0;
+
+SpeedGovernor::SpeedGovernor(AudioSink *nextAudio,
+                             std::function<int()> audioQueued, int audioTarget,
+                             Mode mode)
+    : mode(mode), nextAudio(nextAudio), stretcher(nullptr),
+      audioQueued(audioQueued),
+      audioTarget(audioTarget), rateAdjust(1.0), turbo(false),
+      framesPresented(0), presentedSeen(0), speed(1.0), windowFrames(0),
+      maxFPS(0), audioBlocksDropped(0) {
+  windowStart = std::chrono::steady_clock::now();
+  lastFrame = windowStart;
+}
+
+void SpeedGovernor::endFrame(bool rendered) {
+  if (!isThrottled()) {
+    rateAdjust = 1.0;
+    measureSpeed();
+    if (stretcher) {
+      // Stretch a little more when the device queue is over its target
+      double fill = (double)(audioQueued() - audioTarget) / audioTarget;
+      fill = fill < -1.0 ? -1.0 : (fill > 1.0 ? 1.0 : fill);
+      stretcher->setSpeed(speed * (1.0 + 0.25 * fill));
+    }
+    return;
+  }
+  speed = 1.0;
+  if (stretcher) {
+    stretcher->setSpeed(1.0f);
+  }
+  windowFrames = 0;
+  windowStart = std::chrono::steady_clock::now();
+
+  auto deadline = windowStart + std::chrono::milliseconds(100);
+  if (mode == SYNC_AUDIO) {
+    // The audio device clock sets the pace
+    while (audioQueued() > audioTarget &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  } else if (rendered) {
+    // One emulated frame per presented frame
+    while (framesPresented == presentedSeen &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    presentedSeen = framesPresented;
+  }
+
+  // Dynamic rate control, produce a little more audio when the queue is
+  // below the target and a little less when it is above
+  double fill = (double)(audioQueued() - audioTarget) / audioTarget;
+  fill = fill < -1.0 ? -1.0 : (fill > 1.0 ? 1.0 : fill);
+  rateAdjust = 1.0 - maxRateAdjust * fill;
+  lastFrame = std::chrono::steady_clock::now();
+}
+
+void SpeedGovernor::measureSpeed() {
+  windowFrames++;
+  auto now = std::chrono::steady_clock::now();
+  // Smoothed over about 16 frames
+  double duration = std::chrono::duration<double>(now - lastFrame).count();
+  lastFrame = now;
+  double frameSpeed = frameTime / std::max(duration, 1e-6);
+  speed += (std::max(frameSpeed, 1.0) - speed) / 16;
+  double elapsed = std::chrono::duration<double>(now - windowStart).count();
+  if (elapsed >= 0.5) {
+    double fps = windowFrames / elapsed;
+    if (fps > maxFPS) {
+      maxFPS = fps;
+    }
+    windowFrames = 0;
+    windowStart = now;
+  }
+}
+
+void SpeedGovernor::queueSamples(const float *samples, int count) {
+  if (isThrottled() || stretcher) {
+    nextAudio->queueSamples(samples, count);
+  } else {
+    audioBlocksDropped++;
+  }
+}
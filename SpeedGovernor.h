@@ -0,0 +1,75 @@
+#ifndef SPEEDGOVERNOR_H
+#define SPEEDGOVERNOR_H
+#include "Frontend.h"
+#include "TimeStretcher.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// Decides how fast the emulation thread runs, called once per frame.
+// The emulator is never slowed down from inside the core: the governor
+// waits between frames according to its mode, and it sits in the audio
+// chain so audio that cannot be played in real time is time-stretched (or
+// dropped, without a stretcher) instead of backing up.
+//   SYNC_AUDIO   wait while the audio device has more than its target queued
+//   SYNC_DISPLAY wait for each rendered frame to be presented (vsync)
+//   UNTHROTTLED  never wait
+// Turbo (held from the UI thread) runs unthrottled in any mode.
+class SpeedGovernor : public AudioSink {
+public:
+  enum Mode { SYNC_AUDIO, SYNC_DISPLAY, UNTHROTTLED };
+
+private:
+  Mode mode;
+  AudioSink *nextAudio;              // Where audio goes when throttled
+  TimeStretcher *stretcher;          // Takes all audio when set
+  std::function<int()> audioQueued;  // Floats waiting in the audio device
+  int audioTarget;                   // Floats to keep queued
+  double rateAdjust;                 // Resampling correction for the APU
+  std::atomic<bool> turbo;
+  std::atomic<uint64_t> framesPresented; // Counted by the UI thread
+  uint64_t presentedSeen;
+
+  // Speed while unthrottled, measured over half second windows
+  std::chrono::steady_clock::time_point windowStart;
+  std::chrono::steady_clock::time_point lastFrame;
+  double speed; // Smoothed speed multiplier for the stretcher
+  int windowFrames;
+  double maxFPS;
+  uint64_t audioBlocksDropped;
+
+  void measureSpeed();
+
+public:
+  SpeedGovernor(AudioSink *nextAudio, std::function<int()> audioQueued,
+                int audioTarget, Mode mode = SYNC_AUDIO);
+
+  // All audio goes through the stretcher (it must also be nextAudio), which
+  // keeps the pitch when running faster than real time
+  void setTimeStretcher(TimeStretcher *stretcher) {
+    this->stretcher = stretcher;
+  }
+  void setMode(Mode mode) { this->mode = mode; }
+  Mode getMode() const { return mode; }
+  bool isThrottled() const { return mode != UNTHROTTLED && !turbo; }
+
+  // UI thread
+  void setTurbo(bool enable) { turbo = enable; }
+  void framePresented() { framesPresented++; }
+
+  // Emulation thread, after every frame. Waits as the mode asks (at most
+  // 100 ms so a stalled device cannot hang the emulator). rendered is false
+  // for skipped frames, which are never presented.
+  void endFrame(bool rendered);
+  // Ratio for APU::setRateAdjust, steers the audio queue to its target
+  double getRateAdjust() const { return rateAdjust; }
+
+  // Audio from the APU, passed on while throttled or to a stretcher
+  void queueSamples(const float *samples, int count) override;
+
+  double getMaxFPS() const { return maxFPS; }
+  uint64_t getAudioBlocksDropped() const { return audioBlocksDropped; }
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef STATEIO_H
+#define STATEIO_H
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+
+// Building blocks of save states (see SaveState.h for the file layout).
+// A state is a list of sections, each a 4 character tag, a 32-bit length
+// and the fields of one component in a fixed order. Fields are stored as
+// raw little endian bytes (like every platform this runs on) and bools as
+// one byte, so saving and loading are little more than memcpy.
+
+// Appends sections to a byte vector
+class StateWriter {
+private:
+  std::vector<BYTE> &data;
+  size_t sectionStart; // Offset of the open section's length field
+
+public:
+  StateWriter(std::vector<BYTE> &data) : data(data), sectionStart(0) {}
+
+  void beginSection(const char *tag) {
+    write(tag, 4);
+    sectionStart = data.size();
+    put((uint32_t)0); // Filled in by endSection
+  }
+  void endSection() {
+    uint32_t length = data.size() - sectionStart - 4;
+    memcpy(data.data() + sectionStart, &length, 4);
+  }
+
+  void write(const void *bytes, size_t count) {
+    const BYTE *from = (const BYTE *)bytes;
+    data.insert(data.end(), from, from + count);
+  }
+  template <typename T> void put(const T &value) { write(&value, sizeof(T)); }
+  void put(bool value) { data.push_back(value ? 1 : 0); }
+};
+
+// Reads the sections written by StateWriter. Reading past the end of a
+// section fills with zeros and marks the reader as failed, and so does
+// leaving bytes of a section unread (its layout is not the one expected).
+class StateReader {
+private:
+  const BYTE *data;
+  size_t size;
+  size_t firstSection; // Offset of the first section header
+  size_t position;
+  size_t sectionEnd;
+  bool failed;
+
+public:
+  StateReader(const BYTE *data, size_t size, size_t firstSection)
+      : data(data), size(size), firstSection(firstSection),
+        position(firstSection), sectionEnd(firstSection), failed(false) {}
+
+  // Find a section by tag and get ready to read it, false if it is missing.
+  // The section open before is closed first.
+  bool openSection(const char *tag) {
+    closeSection();
+    size_t offset = firstSection;
+    while (offset + 8 <= size) {
+      uint32_t length;
+      memcpy(&length, data + offset + 4, 4);
+      if (length > size - offset - 8) {
+        break; // Damaged
+      }
+      if (memcmp(data + offset, tag, 4) == 0) {
+        position = offset + 8;
+        sectionEnd = position + length;
+        return true;
+      }
+      offset += 8 + length;
+    }
+    failed = true;
+    return false;
+  }
+  // Done with the open section, which must have been read to its end
+  void closeSection() {
+    if (position != sectionEnd) {
+      failed = true;
+    }
+    position = sectionEnd;
+  }
+
+  void read(void *bytes, size_t count) {
+    if (count > sectionEnd - position) {
+      memset(bytes, 0, count);
+      position = sectionEnd;
+      failed = true;
+      return;
+    }
+    memcpy(bytes, data + position, count);
+    position += count;
+  }
+  template <typename T> void get(T &value) { read(&value, sizeof(T)); }
+  void get(bool &value) {
+    BYTE byte;
+    read(&byte, 1);
+    value = byte != 0;
+  }
+
+  bool ok() const { return !failed; }
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threads)
+    : task(nullptr), taskCount(0), nextIndex(0), busyWorkers(0),
+      generation(0), stopping(false) {
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(int count,
+                             const std::function<void(int)> &task) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    this->task = &task;
+    taskCount = count;
+    nextIndex = 0;
+    busyWorkers = workers.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  // Help out instead of waiting idle
+  runTasks();
+
+  std::unique_lock<std::mutex> guard(lock);
+  finished.wait(guard, [this] { return busyWorkers == 0; });
+  this->task = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+  uint64_t seen = 0; // Last job this worker took part in
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+    }
+    runTasks();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      busyWorkers--;
+      if (busyWorkers == 0) {
+        finished.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::runTasks() {
+  int index;
+  while ((index = nextIndex.fetch_add(1)) < taskCount) {
+    (*task)(index);
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed pool of worker threads for splitting work like the 144 lines
+// of a frame across cores
+class ThreadPool {
+private:
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable wake;     // Signals workers that a job started
+  std::condition_variable finished; // Signals the caller that a job ended
+
+  const std::function<void(int)> *task; // Current job
+  int taskCount;                        // Number of indices in the job
+  std::atomic<int> nextIndex;           // Next index to hand out
+  int busyWorkers;                      // Workers still on the current job
+  uint64_t generation;                  // Incremented for every job
+  bool stopping;
+
+  void workerLoop();
+  void runTasks(); // Take indices until the job is used up
+
+public:
+  // threads is the number of extra threads, the caller also does work
+  ThreadPool(int threads);
+  ~ThreadPool();
+
+  // Run task(0) ... task(count - 1) across the pool and the calling thread,
+  // returns once every index is done
+  void parallelFor(int count, const std::function<void(int)> &task);
+  int getThreadCount() const { return (int)workers.size() + 1; }
+};
+
+#endif
@@ -0,0 +1,32 @@
+#include "ThreadedFrontend.h"
+#include <cstring>
+
+// Frame exchange
+void FrameExchange::presentFrame(const void *pixels, int pitch) {
+  Frame &frame = frames.getWriteBuffer();
+  for (int y = 0; y < 144; y++) {
+    memcpy(&frame.pixels[y * 160],
+           static_cast<const uint8_t *>(pixels) + y * pitch,
+           160 * sizeof(uint32_t));
+  }
+  frames.publish();
+}
+
+const Frame *FrameExchange::takeFrame() {
+  if (!frames.update()) {
+    return nullptr;
+  }
+  return &frames.getReadBuffer();
+}
+
+// Input queue
+bool InputQueue::setButtons(BYTE buttons) { return queue.push(buttons); }
+
+BYTE InputQueue::getButtons() {
+  // Drain the queue, only the latest state matters
+  BYTE state;
+  while (queue.pop(state)) {
+    buttons = state;
+  }
+  return buttons;
+}
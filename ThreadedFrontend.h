@@ -0,0 +1,45 @@
+#ifndef THREADEDFRONTEND_H
+#define THREADEDFRONTEND_H
+#include "Frontend.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
+
+// Frontend pieces used when the emulator runs on its own thread.
+// The emulation thread owns the core, the UI thread only talks to these.
+
+// A complete 160x144 XRGB8888 frame
+struct Frame {
+  uint32_t pixels[160 * 144];
+};
+
+// VideoSink that publishes finished frames through a triple buffer
+class FrameExchange : public VideoSink {
+private:
+  TripleBuffer<Frame> frames;
+
+public:
+  // Emulation thread
+  void presentFrame(const void *pixels, int pitch) override;
+
+  // UI thread, returns the newest frame or nullptr if nothing new arrived
+  const Frame *takeFrame();
+};
+
+// InputSource fed by the UI thread through a lock-free queue
+class InputQueue : public InputSource {
+private:
+  SPSCQueue<BYTE, 64> queue; // Button state changes from the UI thread
+  BYTE buttons;              // Latest state seen by the emulation thread
+
+public:
+  InputQueue() : buttons(0) {}
+
+  // UI thread, returns false if the queue is full and the change must be
+  // sent again later
+  bool setButtons(BYTE buttons);
+
+  // Emulation thread
+  BYTE getButtons() override;
+};
+
+#endif
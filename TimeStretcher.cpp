@@ -0,0 +1,155 @@
+#include "TimeStretcher.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Below this the audio is passed through untouched
+static const float minStretch = 1.01f;
+
+TimeStretcher::TimeStretcher(AudioSink *nextAudio, int sampleRate)
+    : nextAudio(nextAudio), speed(1.0f), running(true), blocksDropped(0),
+      stretching(false), natural(0), nominal(0) {
+  blocks = new SPSCQueue<Block, 64>();
+  // 12 ms segments, searched over +-6 ms
+  hop = sampleRate * 12 / 1000;
+  tolerance = hop / 2;
+  // Raised cosine, fadeIn[i] + fadeIn[hop - 1 - i] == 1
+  fadeIn.resize(hop);
+  const double pi = 3.14159265358979323846;
+  for (int i = 0; i < hop; i++) {
+    double s = sin(pi / 2 * (i + 0.5) / hop);
+    fadeIn[i] = s * s;
+  }
+  worker = std::thread(&TimeStretcher::workerLoop, this);
+}
+
+TimeStretcher::~TimeStretcher() {
+  running = false;
+  wake.notify();
+  worker.join();
+  delete blocks;
+}
+
+void TimeStretcher::queueSamples(const float *samples, int count) {
+  Block *block = blocks->beginPush();
+  if (!block) {
+    blocksDropped++;
+    return;
+  }
+  block->count = std::min(count, 2048);
+  block->speed = speed;
+  memcpy(block->samples, samples, block->count * sizeof(float));
+  blocks->commitPush();
+  wake.notify();
+}
+
+void TimeStretcher::workerLoop() {
+  while (true) {
+    bool stopping = !running;
+    bool didWork = false;
+    while (Block *block = blocks->front()) {
+      process(*block);
+      blocks->releaseFront();
+      didWork = true;
+    }
+    if (!didWork) {
+      if (stopping) {
+        return;
+      }
+      wake.wait();
+    }
+  }
+}
+
+void TimeStretcher::process(const Block &block) {
+  input.insert(input.end(), block.samples, block.samples + block.count);
+  int frames = input.size() / 2;
+
+  if (block.speed < minStretch) {
+    // Segment boundaries are always cross-faded from the natural
+    // continuation, so the input from there on joins without a click
+    if (stretching) {
+      consume(natural);
+      stretching = false;
+    }
+    nextAudio->queueSamples(input.data(), input.size());
+    input.clear();
+    return;
+  }
+
+  if (!stretching) {
+    // Carry on from the last sample that was passed through
+    stretching = true;
+    natural = 0;
+    nominal = -hop;
+  }
+
+  double step = hop * block.speed;
+  while (true) {
+    int target = (int)(nominal + step);
+    // Fell too far behind (the speed estimate was low), skip ahead
+    int backlog = frames - target - 4 * hop;
+    if (backlog > 8 * hop) {
+      target += backlog - 8 * hop;
+    }
+    int from = std::max(target - tolerance, 0);
+    int to = target + tolerance;
+    if (to + 2 * hop > frames || natural + 2 * hop > frames) {
+      break; // Wait for more input
+    }
+    int segment = findSegment(from, to);
+
+    // Fade out the natural continuation, fade in the new segment
+    output.resize(hop * 2);
+    const float *fadingOut = &input[natural * 2];
+    const float *fadingIn = &input[segment * 2];
+    for (int i = 0; i < hop; i++) {
+      float in = fadeIn[i];
+      float out = 1.0f - in;
+      output[i * 2] = fadingOut[i * 2] * out + fadingIn[i * 2] * in;
+      output[i * 2 + 1] = fadingOut[i * 2 + 1] * out + fadingIn[i * 2 + 1] * in;
+    }
+    nextAudio->queueSamples(output.data(), output.size());
+
+    natural = segment + hop;
+    nominal = target;
+    // Drop input nothing can refer to any more
+    int keep = std::min(natural, (int)nominal - tolerance);
+    if (keep > 0) {
+      consume(keep);
+      frames -= keep;
+    }
+  }
+}
+
+// Start in [from, to] whose first hop frames best match the natural
+// continuation, by normalized cross-correlation of the mono signal
+int TimeStretcher::findSegment(int from, int to) const {
+  const float *reference = &input[natural * 2];
+  int best = from;
+  float bestScore = -1e30f;
+  for (int start = from; start <= to; start++) {
+    const float *candidate = &input[start * 2];
+    float dot = 0, energy = 1e-9f;
+    // Every other frame is plenty for finding the alignment
+    for (int i = 0; i < hop; i += 2) {
+      float c = candidate[i * 2] + candidate[i * 2 + 1];
+      float r = reference[i * 2] + reference[i * 2 + 1];
+      dot += c * r;
+      energy += c * c;
+    }
+    float score = dot / sqrtf(energy);
+    if (score > bestScore) {
+      bestScore = score;
+      best = start;
+    }
+  }
+  return best;
+}
+
+// Remove frames from the front of the input
+void TimeStretcher::consume(int frames) {
+  input.erase(input.begin(), input.begin() + frames * 2);
+  natural -= frames;
+  nominal -= frames;
+}
@@ -0,0 +1,60 @@
+#ifndef TIMESTRETCHER_H
+#define TIMESTRETCHER_H
+#include "Frontend.h"
+#include "SPSCQueue.h"
+#include "WakeSignal.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Plays audio produced faster than real time at its normal pitch.
+// Blocks from the emulation thread are copied into a ring and a worker
+// thread shortens them with WSOLA (waveform similarity overlap-add): the
+// output is built from segments taken speed times further apart in the
+// input, each one picked within a small search window so it lines up with
+// the waveform it is cross-faded into. At a speed of 1 blocks are passed
+// on unchanged. The next sink is only ever called from the worker thread.
+class TimeStretcher : public AudioSink {
+private:
+  struct Block {
+    float samples[2048];
+    int count;
+    float speed; // Speed the block was produced at
+  };
+
+  AudioSink *nextAudio;
+  SPSCQueue<Block, 64> *blocks; // Shared with the worker, allocated once
+  float speed;                  // Emulation thread
+
+  std::thread worker;
+  std::atomic<bool> running;
+  WakeSignal wake; // New blocks for the worker
+  std::atomic<uint64_t> blocksDropped;
+
+  // Worker state, all lengths in stereo frames
+  int hop;                  // Output frames per segment
+  int tolerance;            // Search distance around the nominal position
+  std::vector<float> fadeIn; // Rising half of the cross-fade window
+  std::vector<float> input; // Unconsumed input, interleaved stereo
+  std::vector<float> output;
+  bool stretching;
+  int natural;     // Where the last segment continues naturally
+  double nominal;  // Where the next segment should start at this speed
+
+  void workerLoop();
+  void process(const Block &block);
+  int findSegment(int from, int to) const;
+  void consume(int frames);
+
+public:
+  TimeStretcher(AudioSink *nextAudio, int sampleRate);
+  ~TimeStretcher();
+
+  // Emulation thread, speed multiplier of the audio that follows
+  void setSpeed(float speed) { this->speed = speed; }
+  void queueSamples(const float *samples, int count) override;
+
+  uint64_t getBlocksDropped() const { return blocksDropped; }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Timers.h"
+#include "StateIO.h"
 
 Timers::Timers(Interrupts *interrupts)
     : DIV(0), TIMA(0), TMA(0), TAC(0), timaCounter(0), TIMA_Enabled(false),
@@ -86,4 +87,30 @@ void Timers::updateTimers(WORD cycles) {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+// Save states
+void Timers::saveState(StateWriter &state) const {
+  state.beginSection("TIM ");
+  state.put(DIV);
+  state.put(TIMA);
+  state.put(TMA);
+  state.put(TAC);
+  state.put(timaCounter);
+  state.put(TIMA_Enabled);
+  state.put(timaCycles);
+  state.put(divCounter);
+  state.endSection();
+}
+
+void Timers::loadState(StateReader &state) {
+  state.openSection("TIM ");
+  state.get(DIV);
+  state.get(TIMA);
+  state.get(TMA);
+  state.get(TAC);
+  state.get(timaCounter);
+  state.get(TIMA_Enabled);
+  state.get(timaCycles);
+  state.get(divCounter);
+}
@@ -6,6 +6,9 @@
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class Timers {
 private:
     BYTE DIV; // Divider Register
@@ -28,6 +31,10 @@ public:
     void writeData(WORD address, BYTE value); // Write data to the timer registers
     BYTE readData(WORD address) const; // Read data from the timer registers
     void updateTimers(WORD cycles); // Increment the TIMA register
+
+    // Save states
+    void saveState(StateWriter &state) const;
+    void loadState(StateReader &state);
 };
 
 #endif
\ No newline at end of file
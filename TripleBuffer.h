@@ -0,0 +1,42 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+#include <atomic>
+
+// Lock-free triple buffer for handing data from one producer thread to one
+// consumer thread. The producer always has a buffer to write into and the
+// consumer always reads the most recently published one, neither side ever
+// waits for the other.
+template <typename T> class TripleBuffer {
+private:
+  static const int newFlag = 0x4; // Set in middle when it holds new data
+
+  T buffers[3];
+  std::atomic<int> middle; // Index of the shared buffer plus the new flag
+  int writeIndex;          // Buffer owned by the producer
+  int readIndex;           // Buffer owned by the consumer
+
+public:
+  TripleBuffer() : middle(1), writeIndex(0), readIndex(2) {}
+
+  // Producer side
+  T &getWriteBuffer() { return buffers[writeIndex]; }
+  // Swap the written buffer with the shared one and mark it as new
+  void publish() {
+    writeIndex = middle.exchange(writeIndex | newFlag,
+                                 std::memory_order_acq_rel) &
+                 0x3;
+  }
+
+  // Consumer side
+  // Grab the newest buffer if one was published, returns false otherwise
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & newFlag)) {
+      return false;
+    }
+    readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & 0x3;
+    return true;
+  }
+  const T &getReadBuffer() const { return buffers[readIndex]; }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "WAVWriter.h"
+
+WAVWriter::WAVWriter() : file(nullptr), channels(2), samplesWritten(0) {}
+
+WAVWriter::~WAVWriter() { close(); }
+
+static void put16(FILE *file, uint16_t value) {
+  uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+  fwrite(bytes, 1, 2, file);
+}
+
+static void put32(FILE *file, uint32_t value) {
+  uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8),
+                      (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  fwrite(bytes, 1, 4, file);
+}
+
+bool WAVWriter::open(const std::string &path, int sampleRate, int channels) {
+  close();
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  this->channels = channels;
+  samplesWritten = 0;
+  writeHeader(sampleRate);
+  return true;
+}
+
+void WAVWriter::writeHeader(int sampleRate) {
+  uint32_t dataBytes = samplesWritten * sizeof(float);
+  fwrite("RIFF", 1, 4, file);
+  put32(file, 36 + dataBytes);
+  fwrite("WAVE", 1, 4, file);
+  fwrite("fmt ", 1, 4, file);
+  put32(file, 16);                                    // Chunk size
+  put16(file, 3);                                     // IEEE float
+  put16(file, channels);
+  put32(file, sampleRate);
+  put32(file, sampleRate * channels * sizeof(float)); // Bytes per second
+  put16(file, channels * sizeof(float));              // Block align
+  put16(file, 32);                                    // Bits per sample
+  fwrite("data", 1, 4, file);
+  put32(file, dataBytes);
+}
+
+void WAVWriter::write(const float *samples, int count) {
+  if (!file) {
+    return;
+  }
+  // WAV is little endian, like every platform this runs on
+  fwrite(samples, sizeof(float), count, file);
+  samplesWritten += count;
+}
+
+void WAVWriter::close() {
+  if (!file) {
+    return;
+  }
+  // Go back and fill in the sizes
+  uint32_t dataBytes = samplesWritten * sizeof(float);
+  fseek(file, 4, SEEK_SET);
+  put32(file, 36 + dataBytes);
+  fseek(file, 40, SEEK_SET);
+  put32(file, dataBytes);
+  fclose(file);
+  file = nullptr;
+}
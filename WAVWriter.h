@@ -0,0 +1,28 @@
+#ifndef WAVWRITER_H
+#define WAVWRITER_H
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Writes interleaved 32-bit float samples to a WAV file. The sizes in the
+// header are filled in when the file is closed.
+class WAVWriter {
+private:
+  FILE *file;
+  int channels;
+  uint64_t samplesWritten; // Individual samples (all channels)
+
+  void writeHeader(int sampleRate);
+
+public:
+  WAVWriter();
+  ~WAVWriter();
+
+  bool open(const std::string &path, int sampleRate, int channels = 2);
+  void write(const float *samples, int count); // count is in samples
+  void close();
+  bool isOpen() const { return file != nullptr; }
+  uint64_t getFramesWritten() const { return samplesWritten / channels; }
+};
+
+#endif
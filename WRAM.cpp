@@ -1,10 +1,11 @@
 #include "WRAM.h"
+#include "StateIO.h"
 
 WRAM::WRAM() {
   // Initialize WRAM bank to 1
   WRAMBank = 1;
-  // Initialize WRAM with zeros
-  for (int i = 0; i < 0x2000; i++) {
+  // Initialize WRAM with zeros (all 8 banks)
+  for (int i = 0; i < 0x8000; i++) {
     RAM[i] = 0;
   }
 }
@@ -46,4 +47,18 @@ BYTE WRAM::readData(WORD address) const {
     location |= WRAMBank << 12; // Apply WRAM bank selection
   }
   return RAM[location]; // Return the data at the specified address
-}
\ No newline at end of file
+}
+
+// Save states
+void WRAM::saveState(StateWriter &state) const {
+  state.beginSection("WRAM");
+  state.write(RAM, sizeof(RAM));
+  state.put(WRAMBank);
+  state.endSection();
+}
+
+void WRAM::loadState(StateReader &state) {
+  state.openSection("WRAM");
+  state.read(RAM, sizeof(RAM));
+  state.get(WRAMBank);
+}
@@ -6,6 +6,9 @@
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
+class StateWriter;
+class StateReader;
+
 class WRAM {
 private:
   // On classic gameboy, WRAM is 8KB (0x2000 bytes)
@@ -24,6 +27,10 @@ public:
 
   // Set the current WRAM bank (CGB only)
   void setWRAMBank(WORD bank);
+
+  // Save states
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef WAKESIGNAL_H
+#define WAKESIGNAL_H
+#include <condition_variable>
+#include <mutex>
+
+// Lets a worker thread sleep until its producer has queued more work.
+// The producer calls notify() after each push, the worker calls wait() when
+// it finds nothing to do. A notify that comes between the worker's last
+// check and its wait is remembered, so no wake-up is ever missed and the
+// worker never needs to poll. The lock only guards the flag, the producer
+// holds it for a moment and never waits on the worker.
+class WakeSignal {
+private:
+  std::mutex lock;
+  std::condition_variable wake;
+  bool signaled;
+
+public:
+  WakeSignal() : signaled(false) {}
+
+  // Producer side
+  void notify() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      signaled = true;
+    }
+    wake.notify_one();
+  }
+
+  // Worker side, returns at once if notify was called since the last wait
+  void wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    wake.wait(guard, [this]() { return signaled; });
+    signaled = false;
+  }
+};
+
+#endif
@@ -0,0 +1,87 @@
+// Benchmark harness for the GameBoy emulator
+// Runs a ROM headless (no SDL, no video, audio or input) as fast as possible,
+// then reports the emulation speed.
+// ./benchmark <romfile> [options]
+// Options:
+//   --frames N          Number of frames to run (default 3600)
+//   --frameskip N       Render one frame out of every N + 1
+//   --deferred N        Draw each frame at VBlank on N threads
+//   --no-layer-cache    Draw the background and window tile by tile
+#include "CPU.h"
+#include "Memory.h"
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cout << "Usage: " << argv[0]
+         << " romfile [--frames N] [--frameskip N] [--deferred N]"
+            " [--no-layer-cache]\n";
+    exit(-1);
+  }
+  string romFilePath = argv[1];
+  int frames = 3600; // One minute of emulated time
+  int frameSkip = 0;
+  int renderThreads = -1; // Draw every line as it is reached
+  bool layerCache = true;
+  bool launchError = false;
+  for (int i = 2; i < argc; i++) {
+    string arg = argv[i];
+    try {
+      if (arg == "--frames" && i + 1 < argc) {
+        frames = stoi(argv[++i]);
+      } else if (arg == "--frameskip" && i + 1 < argc) {
+        frameSkip = stoi(argv[++i]);
+      } else if (arg == "--deferred" && i + 1 < argc) {
+        renderThreads = stoi(argv[++i]);
+      } else if (arg == "--no-layer-cache") {
+        layerCache = false;
+      } else {
+        launchError = true;
+      }
+    } catch (const logic_error &) { // invalid_argument or out_of_range
+      launchError = true;
+    }
+  }
+  if (launchError) {
+    cout << "Usage: " << argv[0]
+         << " romfile [--frames N] [--frameskip N] [--deferred N]"
+            " [--no-layer-cache]\n";
+    exit(-1);
+  }
+
+  Memory mainMem(romFilePath);
+  CPU CPU(mainMem);
+  if (!mainMem.CBG) {
+    CPU.resetGBNoBios();
+  } else {
+    CPU.resetCGBNoBios();
+  }
+  mainMem.gpu->setFrameSkip(frameSkip);
+  if (renderThreads >= 0) {
+    mainMem.gpu->setDeferredRendering(true, renderThreads);
+  }
+  mainMem.gpu->setLayerCache(layerCache);
+
+  auto start = chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    CPU.runFrame();
+  }
+  double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  // Report the results
+  printf("Frames:   %d (frameskip %d)\n", frames, frameSkip);
+  printf("Rendered: %llu\n",
+         (unsigned long long)mainMem.gpu->getFramesRendered());
+  printf("Skipped:  %llu\n", (unsigned long long)mainMem.gpu->getFramesSkipped());
+  printf("Time:     %.3f s\n", seconds);
+  printf("Speed:    %.1f fps (%.2fx real time)\n", frames / seconds,
+         (frames / seconds) / (4194304.0 / 70224.0));
+  return 0;
+}
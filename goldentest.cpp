@@ -0,0 +1,240 @@
+// Golden frame regression suite
+// Runs ROMs headless for a number of frames with scripted input and compares
+// the hash of every frame against a golden file. The first frame that
+// differs is written out as a PNG next to the golden file.
+// ./goldentest [options] <file.golden>...
+// Options:
+//   --record          Write the hashes into the golden files instead
+//   --deferred N      Draw frames deferred on N threads
+//   --no-layer-cache  Draw the background and window tile by tile
+//
+// Golden file format, one entry per line (# starts a comment):
+//   rom <path>                ROM to run, relative to the golden file
+//   frames <count>            Number of frames to run
+//   input <frame> <buttons>   Buttons held from that frame on, buttons are
+//                             joined with + (A+B+START) or "none"
+//   frame <number> <hash>     Expected 64-bit hash of a frame (hex)
+#include "CPU.h"
+#include "Memory.h"
+#include "PNGWriter.h"
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Plays back the input script, one entry per frame change
+class ScriptedInput : public InputSource {
+private:
+  map<int, BYTE> script; // Frame -> buttons held from then on
+  BYTE buttons;
+
+public:
+  ScriptedInput() : buttons(0) {}
+  void addEntry(int frame, BYTE held) { script[frame] = held; }
+  void startFrame(int frame) {
+    auto entry = script.find(frame);
+    if (entry != script.end()) {
+      buttons = entry->second;
+    }
+  }
+  BYTE getButtons() override { return buttons; }
+};
+
+struct GoldenFile {
+  string path;
+  string rom;
+  int frames;
+  vector<string> header;     // Every line that is not a frame hash
+  vector<uint64_t> hashes;   // Expected hash of each frame
+  vector<bool> hasHash;      // Frame has an expected hash
+};
+
+static bool parseButtons(const string &text, BYTE &buttons) {
+  static const map<string, BYTE> names = {
+      {"RIGHT", BUTTON_RIGHT}, {"LEFT", BUTTON_LEFT},
+      {"UP", BUTTON_UP},       {"DOWN", BUTTON_DOWN},
+      {"A", BUTTON_A},         {"B", BUTTON_B},
+      {"SELECT", BUTTON_SELECT}, {"START", BUTTON_START}};
+  buttons = 0;
+  if (text == "none") {
+    return true;
+  }
+  stringstream parts(text);
+  string name;
+  while (getline(parts, name, '+')) {
+    auto button = names.find(name);
+    if (button == names.end()) {
+      return false;
+    }
+    buttons |= button->second;
+  }
+  return true;
+}
+
+static bool loadGolden(const string &path, GoldenFile &golden,
+                       ScriptedInput &input) {
+  ifstream file(path);
+  if (!file) {
+    printf("%s: cannot open\n", path.c_str());
+    return false;
+  }
+  golden.path = path;
+  golden.frames = 0;
+  string line;
+  int lineNumber = 0;
+  while (getline(file, line)) {
+    lineNumber++;
+    stringstream words(line);
+    string key;
+    if (!(words >> key) || key[0] == '#') {
+      golden.header.push_back(line);
+      continue;
+    }
+    bool ok = true;
+    if (key == "rom") {
+      ok = static_cast<bool>(words >> golden.rom);
+    } else if (key == "frames") {
+      ok = static_cast<bool>(words >> golden.frames);
+    } else if (key == "input") {
+      int frame;
+      string text;
+      BYTE buttons;
+      ok = (words >> frame >> text) && parseButtons(text, buttons);
+      if (ok) {
+        input.addEntry(frame, buttons);
+      }
+    } else if (key == "frame") {
+      int frame;
+      string hash;
+      ok = static_cast<bool>(words >> frame >> hash) && frame >= 0;
+      if (ok) {
+        if (frame >= (int)golden.hashes.size()) {
+          golden.hashes.resize(frame + 1, 0);
+          golden.hasHash.resize(frame + 1, false);
+        }
+        golden.hashes[frame] = strtoull(hash.c_str(), nullptr, 16);
+        golden.hasHash[frame] = true;
+      }
+      continue; // Hashes are rewritten when recording
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      printf("%s:%d: cannot parse \"%s\"\n", path.c_str(), lineNumber,
+             line.c_str());
+      return false;
+    }
+    golden.header.push_back(line);
+  }
+  if (golden.rom.empty() || golden.frames <= 0) {
+    printf("%s: needs a rom and a frame count\n", path.c_str());
+    return false;
+  }
+  // The ROM path is relative to the golden file
+  size_t slash = path.find_last_of('/');
+  if (golden.rom[0] != '/' && slash != string::npos) {
+    golden.rom = path.substr(0, slash + 1) + golden.rom;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  bool record = false;
+  int renderThreads = -1;
+  bool layerCache = true;
+  vector<string> paths;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--record") {
+      record = true;
+    } else if (arg == "--deferred" && i + 1 < argc) {
+      renderThreads = atoi(argv[++i]);
+    } else if (arg == "--no-layer-cache") {
+      layerCache = false;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    // An empty suite must not pass, nothing would have been checked
+    printf("No golden files given, nothing to check (golden files are "
+           "local, see README.md)\n");
+    return 1;
+  }
+
+  PNGWriter png;
+  int failures = 0;
+  for (const string &path : paths) {
+    GoldenFile golden;
+    ScriptedInput input;
+    if (!loadGolden(path, golden, input)) {
+      failures++;
+      continue;
+    }
+
+    // No save file and a stopped cartridge clock, the frames may only depend
+    // on the ROM and the input (and the save file is left alone)
+    Memory mainMem(golden.rom, false);
+    mainMem.setRealTimeClock(false);
+    CPU CPU(mainMem);
+    mainMem.setInputSource(&input);
+    if (!mainMem.CBG) {
+      CPU.resetGBNoBios();
+    } else {
+      CPU.resetCGBNoBios();
+    }
+    mainMem.gpu->setFrameHashing(true);
+    mainMem.gpu->setLayerCache(layerCache);
+    if (renderThreads >= 0) {
+      mainMem.gpu->setDeferredRendering(true, renderThreads);
+    }
+
+    vector<uint64_t> hashes;
+    int diverged = -1;
+    for (int frame = 0; frame < golden.frames; frame++) {
+      input.startFrame(frame);
+      CPU.runFrame();
+      uint64_t hash = mainMem.gpu->getFrameHash();
+      hashes.push_back(hash);
+
+      if (!record && frame < (int)golden.hashes.size() &&
+          golden.hasHash[frame] && golden.hashes[frame] != hash) {
+        diverged = frame;
+        break;
+      }
+    }
+
+    if (record) {
+      ofstream out(path);
+      for (const string &line : golden.header) {
+        out << line << "\n";
+      }
+      char text[64];
+      for (size_t frame = 0; frame < hashes.size(); frame++) {
+        snprintf(text, sizeof(text), "frame %zu %016llx\n", frame,
+                 (unsigned long long)hashes[frame]);
+        out << text;
+      }
+      printf("%s: recorded %zu frames\n", path.c_str(), hashes.size());
+    } else if (diverged >= 0) {
+      string image = path.substr(0, path.rfind('.')) + "-frame" +
+                     to_string(diverged) + ".png";
+      png.write(image, mainMem.gpu->getFrameBuffer(), 160, 144,
+                160 * sizeof(uint32_t));
+      printf("%s: FAIL at frame %d (expected %016llx, got %016llx), "
+             "wrote %s\n",
+             path.c_str(), diverged,
+             (unsigned long long)golden.hashes[diverged],
+             (unsigned long long)hashes[diverged], image.c_str());
+      failures++;
+    } else {
+      printf("%s: ok (%d frames)\n", path.c_str(), golden.frames);
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -1,16 +1,168 @@
 // The main file for the GameBoy emulator
 // To run the emulator, use the command:
-// ./GameBoy <romfile> <screenmultiplier>(optional)
+// ./GameBoy <romfile> <screenmultiplier>(optional) [options]
+// Options:
+//   --frameskip N     Render one frame out of every N + 1
+//   --frameskip auto  Skip frames when emulation falls behind real time
+//   --deferred N      Draw each frame at VBlank on N threads (0 = automatic)
+//   --filter NAME     Scale frames before presenting them, NAME is one of
+//                     nearest2, nearest3, nearest4, scale2x, scale3x, scale4x
+//   --lcd-grid        Darken the gaps between pixels (needs a --filter)
+//   --color-correct   Mimic the colors of the Game Boy Color screen
+//   --blend           Blend each frame with the previous one (LCD ghosting)
+//   --record NAME     Record video and audio to NAME.<format> and NAME.wav
+//   --record-format F Video format for --record: y4m, raw or delta
+//   --sample-rate HZ  Audio output rate: 44100, 48000 or 96000
+//   --latency MS      Target audio latency in milliseconds (default 50)
+//   --sync MODE       What keeps real time: audio (default), display (vsync)
+//                     or none to run as fast as possible
+//   --no-stretch      Drop audio when running faster than real time instead
+//                     of time-stretching it
+//   --apu-log FILE    Record every APU register write to FILE, it can be
+//                     rendered to WAV with ./APU_emulator FILE
+//   --rewind MB       Memory kept for rewinding (default 64, 0 turns it off)
+//   --rewind-interval N  Frames between rewind snapshots (default 1), each
+//                     step back goes back N frames
+//   --run-ahead N     Show the frame N frames ahead of the game (1-4) to hide
+//                     its input lag, costs N extra frames of emulation
+//   --run-ahead-thread  Run the frames ahead on a second instance of the game
+//                     on its own thread
+// Hold Tab to fast-forward and Backspace to rewind. F5 saves the state to
+// <romfile>.state and F7 loads it back.
 #include "CPU.h"
 #include "Memory.h"
+#include "PostProcessor.h"
+#include "Recorder.h"
+#include "Rewind.h"
+#include "RunAhead.h"
+#include "SaveState.h"
+#include "SDLFrontend.h"
+#include "SpeedGovernor.h"
+#include "ThreadedFrontend.h"
+#include "TimeStretcher.h"
 #include <SDL2/SDL.h>
+#include <atomic>
+#include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <thread>
 
 using namespace std;
 
-int screenMultiplier = 4;
+// Length of one Game Boy frame in seconds (70224 cycles at 4.194304 MHz)
+const double frameTime = 70224.0 / 4194304.0;
+
+// Save state requests from the UI thread, handled between frames
+enum StateRequest { STATE_NONE, STATE_SAVE, STATE_LOAD };
+
+// Runs on the emulation thread until running is cleared by the UI thread.
+// Finished frames go out through the video sink set on mainMem, so the
+// presentation speed of the UI thread never changes the emulation timing.
+// The governor paces the loop between frames and hands back the audio
+// resampling correction that keeps the audio ring at its target.
+// Save states are taken and loaded here at the end of a frame, so the
+// machine is never touched by two threads. While rewinding, each frame
+// starts from the previous rewind snapshot instead of where the last one
+// ended. With run-ahead the frame shown comes from RunAhead instead.
+// The APU log only holds register writes, so it ends at the first state
+// loaded or rewound to, a replay could not follow the jump.
+void emulationLoop(Memory &mainMem, CPU &CPU, SDLAudioSink &audioSink,
+                   SpeedGovernor &governor, bool autoFrameSkip,
+                   RunAhead *runAhead, APULogWriter *apuLog,
+                   const string &statePath,
+                   std::atomic<int> &stateRequest, size_t rewindMemory,
+                   int rewindInterval, std::atomic<bool> &rewinding,
+                   std::atomic<bool> &running) {
+  SaveState saveState(CPU, mainMem);
+  Rewind *rewind = nullptr;
+  if (rewindMemory > 0) {
+    rewind = new Rewind(saveState, rewindMemory, rewindInterval);
+  }
+  // Compared against real time for automatic frame skipping
+  Uint64 startTime = SDL_GetPerformanceCounter();
+  uint64_t frameCount = 0;
+  // Measured audio latency
+  double latencyTotal = 0;
+  double latencyMax = 0;
+  uint64_t latencyCount = 0;
+  while (running.load(std::memory_order_relaxed)) {
+    bool steppedBack = rewind && rewinding && rewind->stepBack();
+    if (steppedBack && apuLog) {
+      mainMem.setAPULog(nullptr);
+      apuLog = nullptr;
+      cout << "APU log stopped, rewinding is not recorded\n";
+    }
+
+    bool rendered = true;
+    if (runAhead) {
+      runAhead->runFrame();
+    } else {
+      CPU.runFrame();
+      // Skipped frames have nothing new to present
+      rendered = !mainMem.gpu->frameSkipped();
+      if (rendered) {
+        mainMem.renderGPU();
+      }
+    }
+    frameCount++;
+
+    if (rewind && !steppedBack) {
+      rewind->frameDone();
+    }
+    int request = stateRequest.exchange(STATE_NONE);
+    if (request == STATE_SAVE) {
+      cout << (saveState.saveFile(statePath) ? "Saved state to "
+                                             : "Could not save state to ")
+           << statePath << "\n";
+    } else if (request == STATE_LOAD) {
+      bool loaded = saveState.loadFile(statePath);
+      cout << (loaded ? "Loaded state from " : "Could not load state from ")
+           << statePath << "\n";
+      if (loaded && apuLog) {
+        mainMem.setAPULog(nullptr);
+        apuLog = nullptr;
+        cout << "APU log stopped, loaded states are not recorded\n";
+      }
+    }
+
+    governor.endFrame(rendered);
+    mainMem.setAudioRateAdjust(governor.getRateAdjust());
+    if (!governor.isThrottled()) {
+      // Fast-forward, real time starts again when it ends
+      startTime = SDL_GetPerformanceCounter();
+      frameCount = 0;
+      continue;
+    }
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - startTime) /
+                     SDL_GetPerformanceFrequency();
+    double behind = elapsed - frameCount * frameTime;
+    if (behind > 0.25) {
+      // Too far behind to catch up, start counting from here
+      startTime = SDL_GetPerformanceCounter();
+      frameCount = 0;
+    } else if (behind > frameTime && autoFrameSkip) {
+      // Skip the next frame if we are more than a frame behind real time
+      mainMem.gpu->skipNextFrame();
+    }
+
+    double latency = audioSink.getLatency();
+    latencyTotal += latency;
+    latencyMax = latency > latencyMax ? latency : latencyMax;
+    latencyCount++;
+  }
+  if (latencyCount > 0) {
+    cout << "Audio latency: " << latencyTotal / latencyCount * 1000
+         << " ms average, " << latencyMax * 1000 << " ms max\n";
+  }
+  if (rewind) {
+    cout << "Rewind: " << rewind->getSnapshotCount() << " snapshots in "
+         << rewind->getMemoryUsed() / 1048576.0 << " MB, capture "
+         << rewind->getCaptureTime() * 1e6 << " us average\n";
+    delete rewind;
+  }
+}
 
 int main(int argc, char *argv[]) {
   // Handle arguments
@@ -22,23 +174,130 @@ int main(int argc, char *argv[]) {
   } else {
     launchError = true;
   }
-  if (argc > 2) {
+  int screenMultiplier = 4;
+  int frameSkip = 0;
+  bool autoFrameSkip = false;
+  int renderThreads = -1; // Draw every line as it is reached
+  PostProcessor postProcessor;
+  string recordName;
+  string apuLogPath;
+  Recorder::Format recordFormat = Recorder::FORMAT_Y4M;
+  int sampleRate = 44100;
+  int latencyMs = 50;
+  SpeedGovernor::Mode syncMode = SpeedGovernor::SYNC_AUDIO;
+  bool timeStretch = true;
+  int rewindMB = 64;
+  int rewindInterval = 1;
+  int runAheadFrames = 0;
+  bool runAheadThread = false;
+  for (int i = 2; i < argc; i++) {
+    string arg = argv[i];
     try {
-      screenMultiplier = stoi(argv[2]);
-    } catch (invalid_argument e) {
+      if (arg == "--frameskip" && i + 1 < argc) {
+        string value = argv[++i];
+        if (value == "auto") {
+          autoFrameSkip = true;
+        } else {
+          frameSkip = stoi(value);
+        }
+      } else if (arg == "--deferred" && i + 1 < argc) {
+        renderThreads = stoi(argv[++i]);
+      } else if (arg == "--filter" && i + 1 < argc) {
+        string filter = argv[++i];
+        if (filter.rfind("nearest", 0) == 0) {
+          postProcessor.setScaler(PostProcessor::SCALER_NEAREST,
+                                  stoi(filter.substr(7)));
+        } else if (filter == "scale2x") {
+          postProcessor.setScaler(PostProcessor::SCALER_SCALE2X);
+        } else if (filter == "scale3x") {
+          postProcessor.setScaler(PostProcessor::SCALER_SCALE3X);
+        } else if (filter == "scale4x") {
+          postProcessor.setScaler(PostProcessor::SCALER_SCALE4X);
+        } else {
+          launchError = true;
+        }
+      } else if (arg == "--lcd-grid") {
+        postProcessor.setLCDGrid(true);
+      } else if (arg == "--color-correct") {
+        postProcessor.setColorCorrection(true);
+      } else if (arg == "--blend") {
+        postProcessor.setFrameBlend(true);
+      } else if (arg == "--record" && i + 1 < argc) {
+        recordName = argv[++i];
+      } else if (arg == "--record-format" && i + 1 < argc) {
+        string format = argv[++i];
+        if (format == "y4m") {
+          recordFormat = Recorder::FORMAT_Y4M;
+        } else if (format == "raw") {
+          recordFormat = Recorder::FORMAT_RAW;
+        } else if (format == "delta") {
+          recordFormat = Recorder::FORMAT_DELTA;
+        } else {
+          launchError = true;
+        }
+      } else if (arg == "--sample-rate" && i + 1 < argc) {
+        sampleRate = stoi(argv[++i]);
+        if (sampleRate != 44100 && sampleRate != 48000 && sampleRate != 96000) {
+          launchError = true;
+        }
+      } else if (arg == "--latency" && i + 1 < argc) {
+        latencyMs = stoi(argv[++i]);
+        if (latencyMs < 10 || latencyMs > 250) {
+          launchError = true;
+        }
+      } else if (arg == "--sync" && i + 1 < argc) {
+        string mode = argv[++i];
+        if (mode == "audio") {
+          syncMode = SpeedGovernor::SYNC_AUDIO;
+        } else if (mode == "display") {
+          syncMode = SpeedGovernor::SYNC_DISPLAY;
+        } else if (mode == "none") {
+          syncMode = SpeedGovernor::UNTHROTTLED;
+        } else {
+          launchError = true;
+        }
+      } else if (arg == "--no-stretch") {
+        timeStretch = false;
+      } else if (arg == "--apu-log" && i + 1 < argc) {
+        apuLogPath = argv[++i];
+      } else if (arg == "--rewind" && i + 1 < argc) {
+        rewindMB = stoi(argv[++i]);
+        if (rewindMB < 0) {
+          launchError = true;
+        }
+      } else if (arg == "--rewind-interval" && i + 1 < argc) {
+        rewindInterval = stoi(argv[++i]);
+        if (rewindInterval < 1) {
+          launchError = true;
+        }
+      } else if (arg == "--run-ahead" && i + 1 < argc) {
+        runAheadFrames = stoi(argv[++i]);
+        if (runAheadFrames < 1 || runAheadFrames > 4) {
+          launchError = true;
+        }
+      } else if (arg == "--run-ahead-thread") {
+        runAheadThread = true;
+      } else {
+        screenMultiplier = stoi(arg);
+      }
+    } catch (const logic_error &) { // invalid_argument or out_of_range
       launchError = true;
     }
   }
   if (launchError) {
-    cout << "Usage: " << argv[0] << " romfile screenmultiplier\n";
+    cout << "Usage: " << argv[0]
+         << " romfile screenmultiplier [--frameskip N|auto] [--deferred N]"
+            " [--filter NAME] [--lcd-grid] [--color-correct] [--blend]"
+            " [--record NAME] [--record-format y4m|raw|delta]"
+            " [--sample-rate 44100|48000|96000] [--latency MS]"
+            " [--sync audio|display|none] [--no-stretch] [--apu-log FILE]"
+            " [--rewind MB] [--rewind-interval N] [--run-ahead N]"
+            " [--run-ahead-thread]\n";
     exit(-1);
   }
 
-  // Creat obbjects
-  Memory mainMem(romFilePath);
-  CPU CPU(mainMem);
   // SDL Stuff
-  SDL_Init(SDL_INIT_VIDEO);
+  SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
   SDL_Window *window = 0;
   window = SDL_CreateWindow("GameBoy", SDL_WINDOWPOS_CENTERED,
                             SDL_WINDOWPOS_CENTERED, 160 * screenMultiplier,
@@ -47,42 +306,171 @@ int main(int argc, char *argv[]) {
       window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
   SDL_Event events;
 
-  // Check if bootstrap file is present. If it is, load it in, if not, skip the
-  // bootstrap.
+  // Everything connected to the renderer and the audio device is destroyed
+  // at the end of this scope, before SDL is shut down
+  {
+    // Creat obbjects
+    Memory mainMem(romFilePath);
+    CPU CPU(mainMem);
 
-  if (!mainMem.CBG) {
-    CPU.resetGBNoBios();
-  } else {
-    CPU.resetCGBNoBios();
-  }
+    // Connect the core to the frontend
+    // Audio goes through a lock-free ring to the SDL audio callback, video
+    // and input go through lock-free hand-offs to the UI thread
+    // The latency target is split between the device buffer (about a quarter,
+    // rounded down to a power of two) and the ring, blocks from the APU are
+    // kept below the device buffer so they never add to it
+    int latencyFrames = sampleRate * latencyMs / 1000;
+    int deviceFrames = 256;
+    while (deviceFrames * 2 <= latencyFrames / 4 && deviceFrames < 4096) {
+      deviceFrames *= 2;
+    }
+    int audioTarget = (latencyFrames - deviceFrames) * 2;
+    SDLVideoSink videoSink(ren);
+    SDLAudioSink audioSink(sampleRate, deviceFrames);
+    mainMem.setAudioFormat(sampleRate, deviceFrames);
+    SDLInputSource keyboard;
+    FrameExchange frameExchange;
+    InputQueue inputQueue;
+    // Faster than real time, audio is time-stretched back to normal speed on
+    // its own thread, or dropped by the governor
+    TimeStretcher stretcher(&audioSink, sampleRate);
+    SpeedGovernor governor(
+        timeStretch ? (AudioSink *)&stretcher : &audioSink,
+        [&audioSink]() { return audioSink.getQueuedSamples(); }, audioTarget,
+        syncMode);
+    if (timeStretch) {
+      governor.setTimeStretcher(&stretcher);
+    }
+    // The recorder passes everything on, it only takes copies while recording
+    Recorder recorder(&frameExchange, &governor);
+    if (!recordName.empty() &&
+        !recorder.start(recordName, recordFormat, sampleRate)) {
+      cout << "Could not open " << recordName << " for recording\n";
+    }
+    mainMem.setVideoSink(&recorder);
+    mainMem.setAudioSink(&recorder);
+    mainMem.setInputSource(&inputQueue);
+    // Frames run ahead on the real machine would end up in the APU log
+    if (!apuLogPath.empty() && runAheadFrames > 0 && !runAheadThread) {
+      cout << "--apu-log needs --run-ahead-thread with run-ahead, not "
+              "logging\n";
+      apuLogPath.clear();
+    }
+    APULogWriter apuLog;
+    if (!apuLogPath.empty()) {
+      if (apuLog.open(apuLogPath)) {
+        mainMem.setAPULog(&apuLog);
+      } else {
+        cout << "Could not open " << apuLogPath << " for the APU log\n";
+      }
+    }
+
+    // Check if bootstrap file is present. If it is, load it in, if not, skip
+    // the bootstrap.
+
+    if (!mainMem.CBG) {
+      CPU.resetGBNoBios();
+    } else {
+      CPU.resetCGBNoBios();
+    }
+
+    std::cout << "Color Mode: " << (mainMem.CBG) << std::endl;
+    mainMem.gpu->setFrameSkip(frameSkip);
+    if (renderThreads >= 0) {
+      mainMem.gpu->setDeferredRendering(true, renderThreads);
+    }
 
-  std::cout << "Color Mode: " << (mainMem.CBG) << std::endl;
-  // Main loop
-  bool running = true;
-  while (running) {
-    // SDL Events check
-    SDL_PumpEvents();
-    while (SDL_PollEvent(&events)) {
-      if (events.type == SDL_QUIT) {
-        running = false;
+    RunAhead *runAhead = nullptr;
+    if (runAheadFrames > 0) {
+      runAhead = new RunAhead(CPU, mainMem, runAheadFrames, &inputQueue,
+                              &recorder, &recorder);
+      if (runAheadThread && !runAhead->startSecondInstance()) {
+        cout << "Could not start a second instance, running ahead on one "
+                "thread\n";
       }
     }
-    int cycleCount = 0;
-    // Simulate CPU cycles
-    while (!mainMem.gpu->vBlank) {
-      CPU.executeOneInstruction();
-      int lastCycleCount = CPU.getLastCycleCount();
-      cycleCount += lastCycleCount;
-      if (CPU.getDoubleSpeed()) {
-        mainMem.updateCycles(lastCycleCount / 2);
+
+    // Start emulating
+    string statePath = romFilePath + ".state";
+    std::atomic<int> stateRequest(STATE_NONE);
+    std::atomic<bool> rewinding(false);
+    std::atomic<bool> running(true);
+    std::thread emulationThread(
+        emulationLoop, std::ref(mainMem), std::ref(CPU), std::ref(audioSink),
+        std::ref(governor), autoFrameSkip, runAhead,
+        apuLog.isOpen() ? &apuLog : nullptr, std::cref(statePath),
+        std::ref(stateRequest), (size_t)rewindMB << 20, rewindInterval,
+        std::ref(rewinding), std::ref(running));
+
+    // UI loop, only handles events and presents frames
+    BYTE sentButtons = 0;
+    while (running.load(std::memory_order_relaxed)) {
+      // SDL Events check
+      SDL_PumpEvents();
+      while (SDL_PollEvent(&events)) {
+        if (events.type == SDL_QUIT) {
+          running = false;
+        } else if (events.type == SDL_KEYDOWN && !events.key.repeat) {
+          if (events.key.keysym.sym == SDLK_F5) {
+            stateRequest = STATE_SAVE;
+          } else if (events.key.keysym.sym == SDLK_F7) {
+            stateRequest = STATE_LOAD;
+          }
+        }
+      }
+      // Send the buttons to the emulation thread when they change
+      BYTE buttons = keyboard.getButtons();
+      if (buttons != sentButtons && inputQueue.setButtons(buttons)) {
+        sentButtons = buttons;
+      }
+      governor.setTurbo(SDL_GetKeyboardState(NULL)[SDL_SCANCODE_TAB]);
+      rewinding = SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE];
+      // Present the newest frame, the vsync wait and post-processing only
+      // block this thread
+      const Frame *frame = frameExchange.takeFrame();
+      if (frame && postProcessor.isActive()) {
+        const uint32_t *pixels =
+            postProcessor.process(frame->pixels, 160 * sizeof(uint32_t));
+        videoSink.presentImage(pixels, postProcessor.getWidth(),
+                               postProcessor.getHeight(),
+                               postProcessor.getPitch());
+        governor.framePresented();
+      } else if (frame) {
+        videoSink.presentFrame(frame->pixels, 160 * sizeof(uint32_t));
+        governor.framePresented();
       } else {
-        mainMem.updateCycles(lastCycleCount);
+        SDL_Delay(1);
       }
-      mainMem.updateTimers(lastCycleCount);
     }
-    mainMem.gpu->vBlank = false;
-    mainMem.renderGPU(ren);
+    emulationThread.join();
+    if (runAhead && runAhead->hasSecondInstance()) {
+      cout << "Run-ahead: " << runAhead->getStatesSkipped()
+           << " states replaced before the second instance ran them\n";
+    }
+    delete runAhead;
+    cout << "Audio underruns: " << audioSink.getUnderruns()
+         << ", overruns: " << audioSink.getOverruns() << "\n";
+    if (governor.getMaxFPS() > 0) {
+      cout << "Unthrottled: " << governor.getMaxFPS() << " fps max ("
+           << governor.getMaxFPS() * frameTime << "x real time), "
+           << governor.getAudioBlocksDropped() << " audio blocks dropped\n";
+    }
+    if (apuLog.isOpen()) {
+      mainMem.setAPULog(nullptr);
+      cout << "APU log: " << apuLog.getWrites() << " writes over "
+           << apuLog.getCycles() / 4194304.0 << " s\n";
+      apuLog.close();
+    }
+    if (recorder.isRecording()) {
+      recorder.stop();
+      cout << "Recorded " << recorder.getFramesRecorded() << " frames, dropped "
+           << recorder.getFramesDropped() << " frames and "
+           << recorder.getAudioBlocksDropped() << " audio blocks\n";
+    }
   }
 
+  SDL_DestroyRenderer(ren);
+  SDL_DestroyWindow(window);
+  SDL_Quit();
   return 0;
 }